@@ -1,7 +1,10 @@
 #include "BitcoinExchange.hpp"
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
 
-BitcoinExchange::BitcoinExchange() {}
+BitcoinExchange::BitcoinExchange() : _threads(1), _dataRead(0) {}
 
 BitcoinExchange::BitcoinExchange(const BitcoinExchange &other) {
     *this = other;
@@ -9,172 +12,350 @@ BitcoinExchange::BitcoinExchange(const BitcoinExchange &other) {
 
 BitcoinExchange &BitcoinExchange::operator=(const BitcoinExchange &other) {
     if (this != &other) {
-        _data = other._data;
+        _rates = other._rates;
+        _threads = other._threads;
+        _dataPath = other._dataPath;
+        _dataRead = other._dataRead;
     }
     return *this;
 }
 BitcoinExchange::~BitcoinExchange() {}
 
+// What is said about a data.csv record that parseRecord rejected
+static std::string recordError(RecordStatus status)
+{
+	if (status == RECORD_VALUE_EMPTY)
+		return "Database: Error: invalid value format.4";
+	char number[16];
+	sprintf(number, "%d", static_cast<int>(status));
+	return std::string("Database: Error: invalid date format. ") + number;
+}
+
 void BitcoinExchange::readData()
 {
-	std::ifstream file("data.csv");
-	if (!file.is_open())
+	readData("data.csv");
+}
+
+void BitcoinExchange::readData(const std::string &path)
+{
+	MappedFile file;
+	if (!file.open(path))
 	{
 		std::cerr << "Error: could not open data file." << std::endl;
 		exit(1);
 	}
 
-	std::string line;
-	std::getline(file, line);
-	if (line != "date,exchange_rate")
+	static const char HEADER[] = "date,exchange_rate";
+	const char *line;
+	size_t length;
+	if (!file.nextLine(line, length) || length != sizeof(HEADER) - 1
+		|| std::memcmp(line, HEADER, length) != 0)
 	{
 		std::cerr << "Database: Error: invalid header." << std::endl;
 		exit(1);
 	}
-	while (std::getline(file, line))
+	RateIndex *index = new RateIndex;
+	while (file.nextLine(line, length))
 	{
-		std::stringstream ss(line);
-		std::string date;
-		std::string value;
-		std::getline(ss, date, ',');
-		if (date.length() != 10)
-		{
-			std::cerr << "Database: Error: invalid date format. 1" << std::endl;
-			exit(1);
-		}
-		if (date[4] != '-' || date[7] != '-')
-		{
-			std::cerr << "Database: Error: invalid date format. 2" << std::endl;
-			exit(1);
-		}
-		for (int i = 0; i < 10; ++i)
-		{
-			if (i == 4 || i == 7) // skip the hyphens
-				continue;
-			if (!isdigit(date[i]))
-			{
-				std::cerr << "Database: Error: invalid date format. 3" << std::endl;
-				exit(1);
-			}
-		}
-		std::getline(ss, value, ',');
-		if (value.length() == 0)
+		int date;
+		float price;
+		RecordStatus status = parseRecord(line, length, date, price);
+		if (status != RECORD_OK)
 		{
-			std::cerr << "Database: Error: invalid value format.4" << std::endl;
+			std::cerr << recordError(status) << std::endl;
 			exit(1);
 		}
-		std::stringstream converter(value); // convert string to float
-		float price;
-		converter >> price;
-		_data[date] = price;
+		index->insert(date, price);
+	}
+	index->build();
+	_rates.publish(index);
+	_dataPath = path;
+	_dataRead = file.size();
+}
+
+void BitcoinExchange::writeSnapshot(const std::string &path) const
+{
+	std::string error;
+	RateIndex *index = _rates.mergedCopy();
+	bool saved = index->save(path, error);
+	if (saved)
+		std::cout << "Compiled " << index->size() << " rates into " << path << " ("
+				  << (index->memoryBytes() + 1023) / 1024 << " KiB in memory, "
+				  << (index->hasCalendar() ? "with" : "without") << " a calendar table)."
+				  << std::endl;
+	delete index;
+	if (!saved)
+	{
+		std::cerr << "Error: could not write snapshot: " << error << "." << std::endl;
+		exit(1);
+	}
+}
+
+void BitcoinExchange::loadSnapshot(const std::string &path)
+{
+	std::string error;
+	RateIndex *index = new RateIndex;
+	if (!index->load(path, error))
+	{
+		std::cerr << "Error: could not load snapshot: " << error << "." << std::endl;
+		exit(1);
 	}
+	_rates.publish(index);
 }
 
-bool isValidDate(const std::string &date)
+bool BitcoinExchange::appendRecord(const char *line, size_t length, std::string &error)
 {
-	if (date.length() != 10)
+	RecordStatus status = addRecord(line, length);
+	if (status != RECORD_OK)
+	{
+		if (length > 0 && line[length - 1] == '\r')
+			--length;
+		error = recordError(status) + " => " + std::string(line, length);
 		return false;
-	if (date[4] != '-' || date[7] != '-')
+	}
+	return true;
+}
+
+RecordStatus BitcoinExchange::addRecord(const char *line, size_t length)
+{
+	int date;
+	float price;
+	RecordStatus status = parseRecord(line, length, date, price);
+	if (status == RECORD_OK)
+		_rates.append(date, price);
+	return status;
+}
+
+// A line still being written has no '\n' yet; it is left for the next call
+bool BitcoinExchange::refreshData(size_t &added, std::string &error)
+{
+	MappedFile file;
+	added = 0;
+	error.clear();
+	if (_dataPath.empty())
+	{
+		error = "Error: no data file to refresh (rates loaded from a snapshot).";
 		return false;
-	for (int i = 0; i < 10; ++i)
-	{
-		if (i == 4 || i == 7)
-			continue;
-		if (!isdigit(date[i]))
-			return false;
-	}
-	
-	int year, month, day;
-	std::stringstream ss_year(date.substr(0, 4));
-	ss_year >> year;
-	std::stringstream ss_month(date.substr(5, 2));
-	ss_month >> month;
-	std::stringstream ss_day(date.substr(8, 2));
-	ss_day >> day;
-
-	if (year < 2009 || month < 1 || month > 12 || day < 1 || day > 31)
+	}
+	if (!file.open(_dataPath))
+	{
+		error = "Error: could not open data file.";
 		return false;
-	if (month == 2) {
-		bool isLeap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-		if (isLeap && day > 29) return false;
-		if (!isLeap && day > 28) return false;
 	}
-	if ((month == 4 || month == 6 || month == 9 || month == 11) && day > 30)
+	if (file.size() < _dataRead)
+	{
+		error = "Database: Error: data file shrank; restart to reload it.";
 		return false;
+	}
+
+	const char *begin = file.data() + _dataRead;
+	const char *end = file.data() + file.size();
+	while (end > begin && end[-1] != '\n')
+		--end;
+	while (begin < end)
+	{
+		const char *newline = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+		std::string lineError;
+		if (appendRecord(begin, newline - begin, lineError))
+			++added;
+		else
+		{
+			if (!error.empty())
+				error += "; ";
+			error += lineError;
+		}
+		begin = newline + 1;
+	}
+	_dataRead = end - file.data();
 	return true;
 }
 
-// This function is now corrected with robust parsing
-void BitcoinExchange::processInput(const std::string &filename)
+void BitcoinExchange::setThreads(size_t threads)
+{
+	_threads = (threads == 0) ? 1 : threads;
+}
+
+// Appends `value` as operator<< prints a float by default (%g, 6 digits)
+static void appendFloat(std::string &out, float value)
+{
+	char buffer[32];
+	int length = sprintf(buffer, "%g", static_cast<double>(value));
+	out.append(buffer, length);
+}
+
+// The result or error message of one input line, into the chunk's
+// buffers; `answer` is the line's entry in the lookup batch if it has one
+void BitcoinExchange::printLine(const ParsedLine &parsed, const RateIndex::BatchQuery *answer,
+								ChunkOutput &output)
 {
-	std::ifstream file(filename.c_str());
-	if (!file.is_open())
+	const Query &query = parsed.query;
+	switch (parsed.status)
 	{
-		std::cerr << "Error: could not open file." << std::endl;
+	case QUERY_BAD_DATE:
+		output.error().append("Error: bad input => ").append(query.token, query.tokenLength)
+			+= '\n';
+		return;
+	case QUERY_BAD_LINE:
+		output.error().append("Error: bad input => ").append(parsed.line, parsed.length) += '\n';
 		return;
+	case QUERY_NEGATIVE:
+		output.error() += "Error: not a positive number.\n";
+		return;
+	case QUERY_TOO_LARGE:
+		output.error() += "Error: too large a number.\n";
+		return;
+	case QUERY_OK:
+		break;
 	}
 
-	std::string line;
-	std::getline(file, line); // skip header
-
-	while (std::getline(file, line))
+	// Closest earlier date when there is no exact match
+	if (!answer->found)
 	{
-		std::stringstream ss(line);
-		std::string date;
-		char separator;
-		float value;
+		output.error().append("Error: no data available for date ")
+			.append(query.token, query.tokenLength) += " or earlier.\n";
+		return;
+	}
 
-		// Use stringstream to parse the line. This robustly handles whitespace.
-		if (!(ss >> date >> separator >> value) || separator != '|')
-		{
-			// Special handling for lines that are just bad dates without a separator
-			std::stringstream error_ss(line);
-			std::string error_token;
-			error_ss >> error_token;
-			if (!isValidDate(error_token)) {
-				std::cerr << "Error: bad input => " << error_token << std::endl;
-			} else {
-				std::cerr << "Error: bad input => " << line << std::endl;
-			}
-			continue;
-		}
+	float total = query.value * answer->rate;
+	output.out.append(query.token, query.tokenLength) += " => ";
+	appendFloat(output.out, query.value);
+	output.out += " = ";
+	appendFloat(output.out, total);
+	output.out += '\n';
+}
 
-		// Check for any extra characters on the line after the value
-		std::string remainder;
-		if (ss >> remainder) {
-			std::cerr << "Error: bad input => " << line << std::endl;
-			continue;
-		}
+// Parses the whole chunk first, then looks up all of its dates as one
+// batch, then prints line by line
+void BitcoinExchange::evaluateChunk(void *context, const char *begin, const char *end,
+									ChunkOutput &output)
+{
+	const BitcoinExchange *exchange = static_cast<const BitcoinExchange *>(context);
+	std::vector<ParsedLine> lines;
+	std::vector<RateIndex::BatchQuery> batch;
 
-		if (!isValidDate(date))
+	// STEP 1: parse, and queue the date of every valid query
+	while (begin < end)
+	{
+		const char *newline = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+		const char *lineEnd = (newline != NULL) ? newline : end;
+		ParsedLine parsed;
+		parsed.line = begin;
+		parsed.length = lineEnd - begin;
+		parsed.status = parseQuery(parsed.line, parsed.length, parsed.query);
+		lines.push_back(parsed);
+		if (parsed.status == QUERY_OK)
 		{
-			std::cerr << "Error: bad input => " << date << std::endl;
-			continue;
+			RateIndex::BatchQuery query;
+			query.date = RateIndex::packDate(parsed.query.year, parsed.query.month,
+											 parsed.query.day);
+			batch.push_back(query);
 		}
+		begin = lineEnd + 1;
+	}
 
-		if (value < 0)
-		{
-			std::cerr << "Error: not a positive number." << std::endl;
-			continue;
-		}
-		if (value > 1000)
-		{
-			std::cerr << "Error: too large a number." << std::endl;
-			continue;
-		}
+	// STEP 2: every rate at once
+	if (!batch.empty())
+	{
+		LiveRates::Reader rates(exchange->_rates);
+		rates.lookupBatch(&batch[0], batch.size());
+	}
+
+	// STEP 3: print in input order; valid queries take their answers in turn
+	size_t next = 0;
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		const RateIndex::BatchQuery *answer = NULL;
+		if (lines[i].status == QUERY_OK)
+			answer = &batch[next++];
+		printLine(lines[i], answer, output);
+	}
+}
 
-		std::map<std::string, float>::iterator it = _data.lower_bound(date);
-		if (it == _data.begin() && it->first > date)
+// Lines are evaluated in chunks, on _threads threads, against the read-only
+// index; each chunk's output is written in input order (see ChunkProcessor)
+void BitcoinExchange::processInput(const std::string &filename)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "Error: could not open file." << std::endl;
+		return;
+	}
+
+	const char *line;
+	size_t length;
+	file.nextLine(line, length); // skip header
+
+	std::cout.flush();
+	ChunkProcessor processor(_threads);
+	processor.run(file.data() + file.offset(), file.data() + file.size(), evaluateChunk, this);
+}
+
+// What a server client sends: query lines as in the input file (no header),
+// "+date,exchange_rate" to add a rate, "!refresh" to take in what was
+// appended to the database. Each request gets one line back, in order, and
+// a query sees every rate added before it.
+void BitcoinExchange::serveChunk(void *context, const char *begin, const char *end,
+								 ChunkOutput &output)
+{
+	BitcoinExchange *exchange = static_cast<BitcoinExchange *>(context);
+	const char *queries = begin;	// first query line not answered yet
+	while (begin < end)
+	{
+		const char *newline = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+		const char *lineEnd = (newline != NULL) ? newline : end;
+		if (*begin == '+' || *begin == '!')
 		{
-			std::cerr << "Error: no data available for date " << date << " or earlier." << std::endl;
-			continue;
+			evaluateChunk(exchange, queries, begin, output);
+			exchange->serveCommand(begin, lineEnd - begin, output.out);
+			queries = (newline != NULL) ? newline + 1 : end;
 		}
+		begin = lineEnd + 1;
+	}
+	evaluateChunk(exchange, queries, end, output);
+}
+
+void BitcoinExchange::serveCommand(const char *line, size_t length, std::string &out)
+{
+	while (length > 0 && std::isspace(static_cast<unsigned char>(line[length - 1])))
+		--length;
 
-		if (it == _data.end() || it->first != date)
+	if (line[0] == '+')
+	{
+		RecordStatus status = addRecord(line + 1, length - 1);
+		if (status == RECORD_OK)
+			out.append("Added ").append(line + 1, length - 1) += ".\n";
+		else
+			out.append(recordError(status)) += '\n';
+	}
+	else if (std::string(line, length) == "!refresh")
+	{
+		std::string error;
+		size_t added;
+		if (!refreshData(added, error))
 		{
-			--it;
+			out.append(error) += '\n';
+			return;
 		}
-		
-		std::cout << date << " => " << value << " = " << value * it->second << std::endl;
+		char message[64];
+		sprintf(message, "Refreshed: %lu new rates", static_cast<unsigned long>(added));
+		out += message;
+		if (!error.empty())
+			out.append(", left out: ").append(error);
+		out += ".\n";
 	}
-}
\ No newline at end of file
+	else
+		out.append("Error: unknown command => ").append(line, length) += '\n';
+}
+
+void BitcoinExchange::serve(const std::string &path)
+{
+	QueryServer server(serveChunk, this);
+	std::string error;
+	if (!server.open(path, error))
+	{
+		std::cerr << "Error: could not start server: " << error << "." << std::endl;
+		exit(1);
+	}
+	server.run();
+}
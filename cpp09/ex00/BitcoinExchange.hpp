@@ -3,15 +3,41 @@
 
 #include <iostream>
 #include <string>
-#include <map>
-#include <fstream>
-#include <sstream>
 #include <algorithm>
+#include <vector>
+
+#include "RateIndex.hpp"
+#include "LiveRates.hpp"
+#include "LineParser.hpp"
+#include "MappedFile.hpp"
+#include "ChunkProcessor.hpp"
+#include "QueryServer.hpp"
 
 class BitcoinExchange
 {
 private:
-	std::map<std::string, float> _data;
+	LiveRates _rates;
+	size_t _threads;
+	std::string _dataPath;		// database last read, for refreshData
+	size_t _dataRead;			// bytes of it taken in so far
+
+	// One line of the input, parsed
+	struct ParsedLine
+	{
+		const char *line;
+		size_t length;
+		QueryStatus status;
+		Query query;
+	};
+
+	static void printLine(const ParsedLine &parsed, const RateIndex::BatchQuery *answer,
+						  ChunkOutput &output);
+	static void evaluateChunk(void *context, const char *begin, const char *end,
+							  ChunkOutput &output);
+	static void serveChunk(void *context, const char *begin, const char *end,
+						   ChunkOutput &output);
+	void serveCommand(const char *line, size_t length, std::string &out);
+	RecordStatus addRecord(const char *line, size_t length);
 
 public:
 	BitcoinExchange();
@@ -20,7 +46,24 @@ public:
 	~BitcoinExchange();
 
 	void readData();
+	void readData(const std::string &path);
+	// The rate table as a binary snapshot, to be loaded instead of data.csv
+	void writeSnapshot(const std::string &path) const;
+	void loadSnapshot(const std::string &path);
+	// Adds one "date,exchange_rate" record to the rates being served, which
+	// stay readable meanwhile; a bad record is left out and `error` says why
+	bool appendRecord(const char *line, size_t length, std::string &error);
+	// Appends the complete lines added to the database since it was read:
+	// `added` counts the records taken in and `error` lists the ones left
+	// out ("; " between them). False when the database cannot be read,
+	// with `error` saying why.
+	bool refreshData(size_t &added, std::string &error);
+	// Threads processInput evaluates the input on (1 by default)
+	void setThreads(size_t threads);
 	void processInput(const std::string &filename);
+	// Answers queries sent over the Unix domain socket at `path`, or over
+	// stdin and stdout for "-", until interrupted (see QueryServer)
+	void serve(const std::string &path);
 };
 
 #endif
\ No newline at end of file
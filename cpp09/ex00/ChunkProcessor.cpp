@@ -0,0 +1,163 @@
+#include "ChunkProcessor.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+
+ChunkProcessor::ChunkProcessor(size_t threads)
+	: _threads(threads == 0 ? 1 : threads), _merged(sameTarget(STDOUT_FILENO, STDERR_FILENO)),
+	  _next(NULL), _end(NULL), _taken(0), _written(0), _task(NULL), _context(NULL)
+{
+	_slots.resize(_threads == 1 ? 1 : _threads * CHUNKS_PER_THREAD);
+	for (size_t i = 0; i < _slots.size(); ++i)
+	{
+		_slots[i].output.merged = _merged;
+		_slots[i].done = false;
+	}
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_ready, NULL);
+	pthread_cond_init(&_free, NULL);
+}
+
+ChunkProcessor::~ChunkProcessor()
+{
+	pthread_cond_destroy(&_free);
+	pthread_cond_destroy(&_ready);
+	pthread_mutex_destroy(&_mutex);
+}
+
+// Both descriptors lead to the same file or terminal
+bool ChunkProcessor::sameTarget(int a, int b)
+{
+	struct stat first;
+	struct stat second;
+	if (fstat(a, &first) != 0 || fstat(b, &second) != 0)
+		return false;
+	return first.st_dev == second.st_dev && first.st_ino == second.st_ino;
+}
+
+// CHUNK_BYTES past `begin`, then on to the end of that line
+const char *ChunkProcessor::chunkEnd(const char *begin, const char *end)
+{
+	if (end - begin <= CHUNK_BYTES)
+		return end;
+	const char *p = begin + CHUNK_BYTES;
+	const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+	return (newline != NULL) ? newline + 1 : end;
+}
+
+void ChunkProcessor::writeAll(int fd, const std::string &text)
+{
+	size_t done = 0;
+	while (done < text.size())
+	{
+		ssize_t n = write(fd, text.data() + done, text.size() - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		done += n;
+	}
+}
+
+// Hands out the next chunk once its slot has been written; false when the
+// input is used up
+bool ChunkProcessor::take(size_t &index)
+{
+	pthread_mutex_lock(&_mutex);
+	while (_next < _end && _taken >= _written + _slots.size())
+		pthread_cond_wait(&_free, &_mutex);
+	if (_next >= _end)
+	{
+		pthread_mutex_unlock(&_mutex);
+		return false;
+	}
+	index = _taken++;
+	Slot &slot = _slots[index % _slots.size()];
+	slot.begin = _next;
+	slot.end = chunkEnd(_next, _end);
+	_next = slot.end;
+	pthread_mutex_unlock(&_mutex);
+	return true;
+}
+
+void *ChunkProcessor::workerMain(void *self)
+{
+	ChunkProcessor *processor = static_cast<ChunkProcessor *>(self);
+	size_t index;
+
+	while (processor->take(index))
+	{
+		Slot &slot = processor->_slots[index % processor->_slots.size()];
+		processor->_task(processor->_context, slot.begin, slot.end, slot.output);
+		pthread_mutex_lock(&processor->_mutex);
+		slot.done = true;
+		pthread_cond_signal(&processor->_ready);
+		pthread_mutex_unlock(&processor->_mutex);
+	}
+	return NULL;
+}
+
+// One thread: chunk after chunk on the caller
+void ChunkProcessor::runSerial()
+{
+	ChunkOutput &output = _slots[0].output;
+	while (_next < _end)
+	{
+		const char *chunk = _next;
+		_next = chunkEnd(chunk, _end);
+		_task(_context, chunk, _next, output);
+		writeAll(STDOUT_FILENO, output.out);
+		writeAll(STDERR_FILENO, output.err);
+		output.out.clear();
+		output.err.clear();
+	}
+}
+
+void ChunkProcessor::run(const char *begin, const char *end, Task task, void *context)
+{
+	_next = begin;
+	_end = end;
+	_taken = 0;
+	_written = 0;
+	_task = task;
+	_context = context;
+
+	// STEP 1: workers evaluate chunks while this thread writes them in order
+	std::vector<pthread_t> workers(_threads > 1 ? _threads : 0);
+	size_t started = 0;
+	while (started < workers.size()
+		   && pthread_create(&workers[started], NULL, workerMain, this) == 0)
+		++started;
+	if (started == 0)
+	{
+		runSerial();
+		return;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	while (_written < _taken || _next < _end)
+	{
+		Slot &slot = _slots[_written % _slots.size()];
+		if (_written == _taken || !slot.done)
+		{
+			pthread_cond_wait(&_ready, &_mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&_mutex);
+		writeAll(STDOUT_FILENO, slot.output.out);
+		writeAll(STDERR_FILENO, slot.output.err);
+		slot.output.out.clear();
+		slot.output.err.clear();
+		pthread_mutex_lock(&_mutex);
+		slot.done = false;
+		_written++;
+		pthread_cond_broadcast(&_free);
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	// STEP 2: every chunk is written; the workers are on their way out
+	for (size_t i = 0; i < started; ++i)
+		pthread_join(workers[i], NULL);
+}
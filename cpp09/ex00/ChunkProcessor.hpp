@@ -0,0 +1,82 @@
+#ifndef CHUNKPROCESSOR_HPP
+#define CHUNKPROCESSOR_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+// Bytes of input per chunk; chunks end on a line boundary past this
+#define CHUNK_BYTES (1 << 20)
+
+// Chunks in flight per thread, which bounds the memory held by output that
+// waits for an earlier chunk to be written
+#define CHUNKS_PER_THREAD 4
+
+// What one chunk prints. When stdout and stderr are the same file (a
+// terminal, or 2>&1) errors go into `out` too, so that lines keep their
+// order in it; otherwise each stream gets its own buffer.
+struct ChunkOutput
+{
+	std::string out;
+	std::string err;
+	bool merged;
+
+	ChunkOutput() : merged(false) {}
+
+	std::string &error()
+	{
+		return merged ? out : err;
+	}
+};
+
+// Runs a line-oriented job over [begin, end) in newline-aligned chunks on a
+// fixed number of threads and writes each chunk's output in input order,
+// so what reaches stdout and stderr is byte for byte what a single thread
+// would print. With one thread everything runs on the caller.
+class ChunkProcessor
+{
+private:
+	ChunkProcessor(const ChunkProcessor &other);
+	ChunkProcessor &operator=(const ChunkProcessor &other);
+
+public:
+	// Evaluates the whole lines in [begin, end) into `output`
+	typedef void (*Task)(void *context, const char *begin, const char *end, ChunkOutput &output);
+
+	explicit ChunkProcessor(size_t threads);
+	~ChunkProcessor();
+
+	void run(const char *begin, const char *end, Task task, void *context);
+
+private:
+	struct Slot
+	{
+		const char *begin;
+		const char *end;
+		ChunkOutput output;
+		bool done;
+	};
+
+	size_t _threads;
+	bool _merged;
+	std::vector<Slot> _slots;		// chunk i lives in slot i % _slots.size()
+	const char *_next;				// start of the next chunk to hand out
+	const char *_end;
+	size_t _taken;					// chunks handed out
+	size_t _written;				// chunks written
+	Task _task;
+	void *_context;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _ready;			// a chunk is done
+	pthread_cond_t _free;			// a slot was written and can be reused
+
+	static void *workerMain(void *self);
+	bool take(size_t &index);
+	void runSerial();
+	static const char *chunkEnd(const char *begin, const char *end);
+	static void writeAll(int fd, const std::string &text);
+	static bool sameTarget(int a, int b);
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "LineParser.hpp"
+#include "RateIndex.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <limits>
+
+// Powers of ten that a float holds exactly (5^10 < 2^24)
+static const float EXACT_POWERS[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// Decimal digits that fit in the mantissa accumulator
+#define MAX_MANTISSA_DIGITS 19
+
+// isspace() in the "C" locale
+static bool isSpace(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static void skipSpace(const char *&p, const char *end)
+{
+	while (p < end && isSpace(*p))
+		++p;
+}
+
+// Year, month and day from the digits of "YYYY-MM-DD", once its shape is known
+static void splitDate(const char *s, int &year, int &month, int &day)
+{
+	year = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+	month = (s[5] - '0') * 10 + (s[6] - '0');
+	day = (s[8] - '0') * 10 + (s[9] - '0');
+}
+
+bool parseDate(const char *s, size_t length, int &year, int &month, int &day)
+{
+	if (length != 10 || s[4] != '-' || s[7] != '-')
+		return false;
+	for (int i = 0; i < 10; ++i)
+	{
+		if (i == 4 || i == 7)
+			continue;
+		if (!isDigit(s[i]))
+			return false;
+	}
+	splitDate(s, year, month, day);
+
+	if (year < 2009 || month < 1 || month > 12 || day < 1 || day > 31)
+		return false;
+	if (month == 2)
+	{
+		bool isLeap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+		if (isLeap && day > 29)
+			return false;
+		if (!isLeap && day > 28)
+			return false;
+	}
+	if ((month == 4 || month == 6 || month == 9 || month == 11) && day > 30)
+		return false;
+	return true;
+}
+
+// The grammar is that of the standard library's float extraction: the
+// characters it would take are taken, then converted. Up to 2^24 with at
+// most ten decimals or powers of ten the conversion is one exact float
+// multiplication or division, hence correctly rounded; anything longer
+// goes through strtof, as the stream does.
+bool parseFloat(const char *&cursor, const char *end, float &value)
+{
+	skipSpace(cursor, end);
+	const char *p = cursor;
+	const char *start = p;
+	bool negative = false;
+	if (p < end && (*p == '+' || *p == '-'))
+		negative = (*p++ == '-');
+
+	unsigned long mantissa = 0;
+	int digits = 0;				// significant digits in mantissa
+	int scale = 0;				// power of ten to apply to mantissa
+	bool exact = true;
+	bool found = false;			// at least one mantissa digit
+	for (bool point = false; p < end; ++p)
+	{
+		if (isDigit(*p))
+		{
+			found = true;
+			if (mantissa == 0 && *p == '0')
+			{
+				if (point)
+					scale--;
+				continue;
+			}
+			if (digits < MAX_MANTISSA_DIGITS)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits++;
+				if (point)
+					scale--;
+			}
+			else
+			{
+				exact = exact && *p == '0';
+				if (!point)
+					scale++;
+			}
+		}
+		else if (*p == '.' && !point)
+			point = true;
+		else
+			break;
+	}
+
+	bool valid = found;
+	if (found && p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExponent = false;
+		if (p < end && (*p == '+' || *p == '-'))
+			negativeExponent = (*p++ == '-');
+		int exponent = 0;
+		valid = false;
+		while (p < end && isDigit(*p))
+		{
+			if (exponent < 100000)
+				exponent = exponent * 10 + (*p - '0');
+			valid = true;
+			++p;
+		}
+		scale += negativeExponent ? -exponent : exponent;
+	}
+	cursor = p;
+	if (!valid)
+	{
+		value = 0;
+		return false;
+	}
+
+	if (exact && mantissa <= (1UL << 24) && scale >= -10 && scale <= 10)
+	{
+		value = static_cast<float>(mantissa);
+		if (scale > 0)
+			value *= EXACT_POWERS[scale];
+		else if (scale < 0)
+			value /= EXACT_POWERS[-scale];
+		if (negative)
+			value = -value;
+		return true;
+	}
+
+	char buffer[64];
+	size_t length = p - start;
+	if (length < sizeof(buffer))
+	{
+		std::memcpy(buffer, start, length);
+		buffer[length] = '\0';
+		value = std::strtof(buffer, NULL);
+	}
+	else
+		value = std::strtof(std::string(start, length).c_str(), NULL);
+	if (value == std::numeric_limits<float>::infinity()
+		|| value == -std::numeric_limits<float>::infinity())
+	{
+		value = (value > 0) ? std::numeric_limits<float>::max() : -std::numeric_limits<float>::max();
+		return false;
+	}
+	return true;
+}
+
+// Same steps as reading `date`, a separator char and `value` with operator>>
+// and then checking that nothing but whitespace is left
+QueryStatus parseQuery(const char *line, size_t length, Query &query)
+{
+	const char *p = line;
+	const char *end = line + length;
+
+	skipSpace(p, end);
+	query.token = p;
+	while (p < end && !isSpace(*p))
+		++p;
+	query.tokenLength = p - query.token;
+	bool dateValid = parseDate(query.token, query.tokenLength, query.year, query.month,
+							   query.day);
+
+	bool read = query.tokenLength > 0;
+	char separator = '\0';
+	if (read)
+	{
+		skipSpace(p, end);
+		read = (p < end);
+		if (read)
+			separator = *p++;
+	}
+	if (read)
+		read = parseFloat(p, end, query.value);
+	if (!read || separator != '|')
+	{
+		// Lines that are just a bad date show the date, others the line
+		return dateValid ? QUERY_BAD_LINE : QUERY_BAD_DATE;
+	}
+
+	skipSpace(p, end);
+	if (p != end)
+		return QUERY_BAD_LINE;
+	if (!dateValid)
+		return QUERY_BAD_DATE;
+	if (query.value < 0)
+		return QUERY_NEGATIVE;
+	if (query.value > 1000)
+		return QUERY_TOO_LARGE;
+	return QUERY_OK;
+}
+
+RecordStatus parseRecord(const char *line, size_t length, int &date, float &rate)
+{
+	const char *end = line + length;
+	const char *comma = static_cast<const char *>(std::memchr(line, ',', length));
+	size_t dateLength = (comma != NULL) ? static_cast<size_t>(comma - line) : length;
+
+	if (dateLength != 10)
+		return RECORD_DATE_LENGTH;
+	if (line[4] != '-' || line[7] != '-')
+		return RECORD_DATE_HYPHENS;
+	for (int i = 0; i < 10; ++i)
+	{
+		if (i == 4 || i == 7) // skip the hyphens
+			continue;
+		if (!isDigit(line[i]))
+			return RECORD_DATE_DIGITS;
+	}
+	if (comma == NULL || comma + 1 == end || comma[1] == ',')
+		return RECORD_VALUE_EMPTY;
+
+	int year, month, day;
+	splitDate(line, year, month, day);
+	date = RateIndex::packDate(year, month, day);
+
+	// The value field ends at the next comma; whatever follows the number
+	// inside it is ignored
+	const char *value = comma + 1;
+	const char *valueEnd = static_cast<const char *>(std::memchr(value, ',', end - value));
+	parseFloat(value, (valueEnd != NULL) ? valueEnd : end, rate);
+	return RECORD_OK;
+}
@@ -0,0 +1,58 @@
+#ifndef LINEPARSER_HPP
+#define LINEPARSER_HPP
+
+#include <cstddef>
+
+// Parsers for data.csv records and "date | value" query lines that work on
+// a character span in place: no streams, no substrings, no allocation in
+// the common case. They accept and reject exactly what the stream-based
+// parsing accepted and rejected, so every message stays the same.
+
+// Outcome of parseQuery, one per message processInput prints
+enum QueryStatus
+{
+	QUERY_OK,
+	QUERY_BAD_DATE,		// "Error: bad input => <token>"
+	QUERY_BAD_LINE,		// "Error: bad input => <line>"
+	QUERY_NEGATIVE,		// "Error: not a positive number."
+	QUERY_TOO_LARGE		// "Error: too large a number."
+};
+
+// Outcome of parseRecord; the numbers match the database error messages
+enum RecordStatus
+{
+	RECORD_OK,
+	RECORD_DATE_LENGTH = 1,
+	RECORD_DATE_HYPHENS = 2,
+	RECORD_DATE_DIGITS = 3,
+	RECORD_VALUE_EMPTY = 4
+};
+
+struct Query
+{
+	const char *token;		// first whitespace-separated token: the date
+	size_t tokenLength;
+	int year;
+	int month;
+	int day;
+	float value;
+};
+
+// "YYYY-MM-DD" with a real calendar date from 2009 on
+bool parseDate(const char *s, size_t length, int &year, int &month, int &day);
+
+// Reads a float the way operator>> does: [+-]digits[.digits][e[+-]digits],
+// after leading whitespace, stopping at the first character that does not
+// fit. Returns false (with value 0) when what was read is not a number, and
+// false (with value +-FLT_MAX) when it overflows. `cursor` is left after
+// the characters read.
+bool parseFloat(const char *&cursor, const char *end, float &value);
+
+// One line of the input file, without its '\n'
+QueryStatus parseQuery(const char *line, size_t length, Query &query);
+
+// One line of data.csv: `date` is packed as in RateIndex; `rate` is 0 when
+// the value field is not a number
+RecordStatus parseRecord(const char *line, size_t length, int &date, float &rate);
+
+#endif
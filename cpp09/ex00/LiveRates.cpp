@@ -0,0 +1,205 @@
+#include "LiveRates.hpp"
+
+#include <sched.h>
+
+LiveRates::Version::Version(RateIndex *built) : index(built), tailSize(0) {}
+
+LiveRates::Version::~Version()
+{
+	delete index;
+}
+
+LiveRates::LiveRates() : _epoch(1)
+{
+	RateIndex *empty = new RateIndex;
+	empty->build();
+	_current = new Version(empty);
+	for (size_t i = 0; i < LIVE_MAX_READERS; ++i)
+		_slots[i] = 0;
+	pthread_mutex_init(&_writer, NULL);
+}
+
+LiveRates::LiveRates(const LiveRates &other) : _epoch(1)
+{
+	_current = new Version(other.mergedCopy());
+	for (size_t i = 0; i < LIVE_MAX_READERS; ++i)
+		_slots[i] = 0;
+	pthread_mutex_init(&_writer, NULL);
+}
+
+LiveRates &LiveRates::operator=(const LiveRates &other)
+{
+	if (this != &other)
+		publish(other.mergedCopy());
+	return *this;
+}
+
+// Nothing may be reading any more
+LiveRates::~LiveRates()
+{
+	for (size_t i = 0; i < _retired.size(); ++i)
+		delete _retired[i].version;
+	delete _current;
+	pthread_mutex_destroy(&_writer);
+}
+
+// The index of `version` with the first `tailSize` tail entries added
+RateIndex *LiveRates::mergedIndex(const Version *version, size_t tailSize)
+{
+	RateIndex *index = new RateIndex(*version->index);
+	for (size_t i = 0; i < tailSize; ++i)
+		index->insert(version->tail[i].date, version->tail[i].rate);
+	index->build();
+	return index;
+}
+
+// Swaps in `version` and retires the one it replaces; the writer lock is held.
+// The new version is visible before the epoch moves, so a reader that starts
+// in the new epoch cannot pick up the old version.
+void LiveRates::install(Version *version)
+{
+	Version *old = _current;
+	__sync_synchronize();
+	_current = version;
+	Retired retired;
+	retired.version = old;
+	retired.epoch = __sync_add_and_fetch(&_epoch, 1);
+	_retired.push_back(retired);
+	reclaim();
+}
+
+// Frees the retired versions that no open reader can still be using
+void LiveRates::reclaim()
+{
+	__sync_synchronize();
+	unsigned long oldest = 0;
+	for (size_t i = 0; i < LIVE_MAX_READERS; ++i)
+	{
+		unsigned long epoch = _slots[i];
+		if (epoch != 0 && (oldest == 0 || epoch < oldest))
+			oldest = epoch;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < _retired.size(); ++i)
+	{
+		if (oldest == 0 || _retired[i].epoch <= oldest)
+			delete _retired[i].version;
+		else
+			_retired[kept++] = _retired[i];
+	}
+	_retired.resize(kept);
+}
+
+void LiveRates::publish(RateIndex *index)
+{
+	pthread_mutex_lock(&_writer);
+	install(new Version(index));
+	pthread_mutex_unlock(&_writer);
+}
+
+void LiveRates::append(int date, float rate)
+{
+	pthread_mutex_lock(&_writer);
+	Version *version = _current;
+	size_t size = version->tailSize;
+	if (size == LIVE_TAIL_CAPACITY)
+	{
+		install(new Version(mergedIndex(version, size)));
+		version = _current;
+		size = 0;
+	}
+	version->tail[size].date = date;
+	version->tail[size].rate = rate;
+	// The entry is complete before the length that makes it visible
+	__sync_synchronize();
+	version->tailSize = size + 1;
+	reclaim();
+	pthread_mutex_unlock(&_writer);
+}
+
+RateIndex *LiveRates::mergedCopy() const
+{
+	Reader reader(*this);
+	return mergedIndex(reader._version, reader._tailSize);
+}
+
+// Claims a free slot with the current epoch, then reads the version. With
+// more than LIVE_MAX_READERS readers open at once the extra ones yield
+// until a slot frees up.
+LiveRates::Reader::Reader(const LiveRates &rates) : _rates(rates), _slot(0)
+{
+	while (true)
+	{
+		unsigned long epoch = rates._epoch;
+		size_t i = 0;
+		while (i < LIVE_MAX_READERS && !__sync_bool_compare_and_swap(&rates._slots[i], 0, epoch))
+			++i;
+		if (i < LIVE_MAX_READERS)
+		{
+			_slot = i;
+			break;
+		}
+		sched_yield();
+	}
+
+	_version = rates._current;
+	_tailSize = _version->tailSize;
+	// The entries are read after their length
+	__sync_synchronize();
+
+	_tailFirst = 0;
+	for (size_t i = 0; i < _tailSize; ++i)
+	{
+		if (i == 0 || _version->tail[i].date < _tailFirst)
+			_tailFirst = _version->tail[i].date;
+	}
+}
+
+LiveRates::Reader::~Reader()
+{
+	__sync_lock_release(&_rates._slots[_slot]);
+}
+
+// Latest tail entry on or before `date`; of equal dates the last appended
+bool LiveRates::Reader::latestInTail(int date, int &entryDate, float &rate) const
+{
+	bool found = false;
+	for (size_t i = 0; i < _tailSize; ++i)
+	{
+		const Entry &entry = _version->tail[i];
+		if (entry.date <= date && (!found || entry.date >= entryDate))
+		{
+			entryDate = entry.date;
+			rate = entry.rate;
+			found = true;
+		}
+	}
+	return found;
+}
+
+// The tail wins over the index when its entry is as recent or more
+bool LiveRates::Reader::find(int date, float &rate) const
+{
+	int indexDate = 0;
+	int tailDate = 0;
+	float tailRate = 0;
+	bool inIndex = _version->index->findEntry(date, indexDate, rate);
+	if (_tailSize == 0 || date < _tailFirst || !latestInTail(date, tailDate, tailRate))
+		return inIndex;
+	if (!inIndex || tailDate >= indexDate)
+		rate = tailRate;
+	return true;
+}
+
+void LiveRates::Reader::lookupBatch(RateIndex::BatchQuery *queries, size_t count) const
+{
+	_version->index->lookupBatch(queries, count);
+	if (_tailSize == 0)
+		return;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (queries[i].date >= _tailFirst)
+			queries[i].found = find(queries[i].date, queries[i].rate);
+	}
+}
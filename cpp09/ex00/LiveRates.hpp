@@ -0,0 +1,109 @@
+#ifndef LIVERATES_HPP
+#define LIVERATES_HPP
+
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+#include "RateIndex.hpp"
+
+// Appended rates held in the tail before the writer folds them into a new
+// index; readers scan the tail linearly, so it stays short
+#define LIVE_TAIL_CAPACITY 64
+
+// Readers that can be open at the same time without waiting for a slot
+#define LIVE_MAX_READERS 256
+
+// Rates that can grow while they are being read. Readers see an immutable
+// version: a built RateIndex plus an append-only tail of recent rates.
+// append() writes the next tail entry and then publishes the new length,
+// so a reader that opened earlier never sees it change under it. When the
+// tail is full, the writer builds a new index from the old one and the
+// tail, and swaps in a version that points to it.
+//
+// Readers never block and never write anything shared but their own slot.
+// Retired versions are freed by epochs. A reader marks its slot with the
+// epoch it started in, and a version retired in a later epoch waits until
+// every slot has moved past it. Writers are serialised by a mutex.
+class LiveRates
+{
+private:
+	struct Entry
+	{
+		int date;
+		float rate;
+	};
+
+	struct Version
+	{
+		RateIndex *index;
+		Entry tail[LIVE_TAIL_CAPACITY];
+		volatile size_t tailSize;
+
+		explicit Version(RateIndex *built);
+		~Version();
+	};
+
+	struct Retired
+	{
+		Version *version;
+		unsigned long epoch;
+	};
+
+public:
+	LiveRates();
+	// A copy serves the same rates, merged into an index of its own
+	LiveRates(const LiveRates &other);
+	LiveRates &operator=(const LiveRates &other);
+	~LiveRates();
+
+	// Serves `index` (built, and owned from now on) in place of everything
+	void publish(RateIndex *index);
+	// Adds a rate, seen by readers opened from now on; when a date is added
+	// twice the later rate wins
+	void append(int date, float rate);
+
+	// A new index, the caller's, holding the current rates tail included
+	RateIndex *mergedCopy() const;
+
+	// A consistent view for one batch of lookups. Opening it takes a free
+	// reader slot and the current version, without waiting for a writer.
+	class Reader
+	{
+	private:
+		Reader(const Reader &other);
+		Reader &operator=(const Reader &other);
+
+	public:
+		explicit Reader(const LiveRates &rates);
+		~Reader();
+
+		bool find(int date, float &rate) const;
+		// RateIndex::lookupBatch, then the tail for the dates it can change
+		void lookupBatch(RateIndex::BatchQuery *queries, size_t count) const;
+
+	private:
+		const LiveRates &_rates;
+		size_t _slot;
+		const Version *_version;
+		size_t _tailSize;
+		int _tailFirst;		// earliest date in the tail
+
+		bool latestInTail(int date, int &entryDate, float &rate) const;
+
+		friend class LiveRates;
+	};
+
+private:
+	Version *volatile _current;
+	mutable volatile unsigned long _slots[LIVE_MAX_READERS];	// 0 when free
+	volatile unsigned long _epoch;
+	std::vector<Retired> _retired;
+	pthread_mutex_t _writer;
+
+	static RateIndex *mergedIndex(const Version *version, size_t tailSize);
+	void install(Version *version);
+	void reclaim();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "MappedFile.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile() : _map(NULL), _mapSize(0), _data(NULL), _size(0), _pos(0) {}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::close()
+{
+	if (_map != NULL)
+		munmap(_map, _mapSize);
+	_map = NULL;
+	_mapSize = 0;
+	_buffer.clear();
+	_data = NULL;
+	_size = 0;
+	_pos = 0;
+}
+
+bool MappedFile::open(const std::string &path, Access access)
+{
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+	{
+		void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			madvise(map, info.st_size, (access == SEQUENTIAL) ? MADV_SEQUENTIAL : MADV_WILLNEED);
+			_map = map;
+			_mapSize = info.st_size;
+			_data = static_cast<const char *>(map);
+			_size = _mapSize;
+			::close(fd);
+			return true;
+		}
+	}
+
+	readStream(fd);
+	::close(fd);
+	return true;
+}
+
+// What cannot be mapped is read whole, 1 MiB at a time
+void MappedFile::readStream(int fd)
+{
+	const size_t chunk = 1 << 20;
+	size_t used = 0;
+
+	while (true)
+	{
+		if (_buffer.size() < used + chunk)
+			_buffer.resize(used + chunk);
+		ssize_t got = read(fd, &_buffer[used], chunk);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		used += got;
+	}
+	_data = _buffer.empty() ? NULL : &_buffer[0];
+	_size = used;
+}
+
+const char *MappedFile::data() const
+{
+	return _data;
+}
+
+size_t MappedFile::size() const
+{
+	return _size;
+}
+
+size_t MappedFile::offset() const
+{
+	return (_pos < _size) ? _pos : _size;
+}
+
+bool MappedFile::nextLine(const char *&line, size_t &length)
+{
+	if (_pos >= _size)
+		return false;
+	line = _data + _pos;
+	const char *newline = static_cast<const char *>(std::memchr(line, '\n', _size - _pos));
+	length = (newline != NULL) ? static_cast<size_t>(newline - line) : _size - _pos;
+	_pos += length + 1;
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Read-only view of a whole file. Regular files are mmap'ed, with
+// MADV_SEQUENTIAL for readers that make one pass from front to back or
+// MADV_WILLNEED for those that keep the file and read it anywhere; pipes
+// and the like are read into a buffer. Lines are handed out in
+// place, found with memchr, so reading a line allocates nothing.
+class MappedFile
+{
+private:
+	MappedFile(const MappedFile &other);
+	MappedFile &operator=(const MappedFile &other);
+
+public:
+	// How the mapping will be read
+	enum Access
+	{
+		SEQUENTIAL,		// once, front to back
+		RESIDENT		// all of it, in any order, for as long as it is open
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	// False only if the file cannot be opened; a read error ends the data
+	// early, as it ends a stream
+	bool open(const std::string &path, Access access = SEQUENTIAL);
+
+	const char *data() const;
+	size_t size() const;
+
+	// Next line without its '\n', the way std::getline splits: a last line
+	// without '\n' still counts, nothing after a final '\n' does
+	bool nextLine(const char *&line, size_t &length);
+	// Bytes consumed by nextLine so far
+	size_t offset() const;
+
+private:
+	void *_map;
+	size_t _mapSize;
+	std::vector<char> _buffer;
+	const char *_data;
+	size_t _size;
+	size_t _pos;
+
+	void readStream(int fd);
+	void close();
+};
+
+#endif
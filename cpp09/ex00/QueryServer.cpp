@@ -0,0 +1,317 @@
+#include "QueryServer.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+
+static volatile sig_atomic_t g_stopRequested = 0;
+
+static void requestStop(int)
+{
+	g_stopRequested = 1;
+}
+
+QueryServer::QueryServer(Handler handler, void *context)
+	: _handler(handler), _context(context), _listener(-1), _epoll(-1),
+	  _buffer(SERVER_READ_BYTES)
+{}
+
+QueryServer::~QueryServer()
+{
+	while (!_clients.empty())
+		closeClient(*_clients.begin()->second);
+	if (_listener >= 0)
+	{
+		close(_listener);
+		unlink(_path.c_str());
+	}
+	if (_epoll >= 0)
+		close(_epoll);
+}
+
+// A server answers on `path` right now
+bool QueryServer::inUse(const std::string &path)
+{
+	int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe < 0)
+		return false;
+	struct sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path.c_str());
+	bool answered = connect(probe, reinterpret_cast<struct sockaddr *>(&address),
+							sizeof(address)) == 0;
+	close(probe);
+	return answered;
+}
+
+bool QueryServer::open(const std::string &path, std::string &error)
+{
+	if (path == "-")
+		return true;
+
+	struct sockaddr_un address;
+	if (path.empty() || path.size() >= sizeof(address.sun_path))
+	{
+		error = "bad socket path " + path;
+		return false;
+	}
+	struct stat info;
+	if (lstat(path.c_str(), &info) == 0)
+	{
+		if (!S_ISSOCK(info.st_mode))
+		{
+			error = path + " exists and is not a socket";
+			return false;
+		}
+		if (inUse(path))
+		{
+			error = "another server is listening on " + path;
+			return false;
+		}
+		unlink(path.c_str());
+	}
+
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path.c_str());
+	_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (_listener < 0
+		|| bind(_listener, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+	_path = path;
+	if (listen(_listener, SOMAXCONN) != 0)
+	{
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+
+	_epoll = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;			// the listener
+	if (_epoll < 0 || epoll_ctl(_epoll, EPOLL_CTL_ADD, _listener, &event) != 0)
+	{
+		error = std::string("epoll: ") + std::strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+// Interrupted system calls return, so the loops get to see the request
+// to stop; a client that went away shows up as a failed write, not SIGPIPE
+void QueryServer::installSignals()
+{
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = requestStop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, NULL);
+}
+
+void QueryServer::run()
+{
+	installSignals();
+	if (_listener < 0)
+	{
+		servePipe();
+		return;
+	}
+
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	while (!g_stopRequested)
+	{
+		int ready = epoll_wait(_epoll, events, SERVER_MAX_EVENTS, -1);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0)
+			break;
+		for (int i = 0; i < ready; ++i)
+		{
+			Client *client = static_cast<Client *>(events[i].data.ptr);
+			if (client == NULL)
+			{
+				acceptClients();
+				continue;
+			}
+			bool alive = true;
+			if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !client->ended)
+			{
+				alive = receive(*client);
+				answer(*client);
+			}
+			if (alive)
+				alive = flush(*client);
+			if (alive)
+				update(*client);
+			else
+				closeClient(*client);
+		}
+	}
+}
+
+// stdin to stdout, one read at a time
+void QueryServer::servePipe()
+{
+	Client client;
+	client.in = STDIN_FILENO;
+	client.out = STDOUT_FILENO;
+	client.sent = 0;
+	client.ended = false;
+	client.events = 0;
+	while (!client.ended && !g_stopRequested)
+	{
+		if (!receive(client))
+			break;
+		answer(client);
+		if (!flush(client))
+			break;
+	}
+}
+
+void QueryServer::acceptClients()
+{
+	while (true)
+	{
+		int fd = accept4(_listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0 && errno == EINTR)
+			continue;
+		if (fd < 0)
+			return;
+
+		Client *client = new Client;
+		client->in = fd;
+		client->out = fd;
+		client->sent = 0;
+		client->ended = false;
+		client->events = EPOLLIN;
+		struct epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events = client->events;
+		event.data.ptr = client;
+		if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			close(fd);
+			delete client;
+			continue;
+		}
+		_clients[fd] = client;
+	}
+}
+
+// One read into the client's input; false when the connection failed.
+// The end of the input marks the client as ended.
+bool QueryServer::receive(Client &client)
+{
+	ssize_t got = read(client.in, &_buffer[0], _buffer.size());
+	if (got > 0)
+	{
+		client.input.insert(client.input.end(), _buffer.begin(), _buffer.begin() + got);
+		return true;
+	}
+	if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return true;
+	client.ended = true;
+	return got == 0;
+}
+
+// Hands the whole lines received so far to the handler as one batch (the
+// last, unterminated line too once the input has ended)
+void QueryServer::answer(Client &client)
+{
+	size_t size = client.input.size();
+	size_t batch = size;
+	if (!client.ended)
+	{
+		while (batch > 0 && client.input[batch - 1] != '\n')
+			--batch;
+	}
+	if (batch > 0)
+	{
+		// The handler appends to what is still waiting to be sent
+		ChunkOutput output;
+		output.merged = true;
+		client.output.erase(0, client.sent);
+		client.sent = 0;
+		output.out.swap(client.output);
+		_handler(_context, &client.input[0], &client.input[0] + batch, output);
+		output.out.swap(client.output);
+		client.input.erase(client.input.begin(), client.input.begin() + batch);
+	}
+
+	// What is left is one unfinished line; past the limit nothing more is
+	// read, and the client is closed once its answers are out
+	if (!client.ended && client.input.size() > SERVER_LINE_LIMIT)
+	{
+		std::vector<char>().swap(client.input);
+		client.ended = true;
+		client.output += "Error: line too long.\n";
+	}
+}
+
+// Writes what the socket takes now; false when the client is gone
+bool QueryServer::flush(Client &client)
+{
+	while (client.sent < client.output.size())
+	{
+		ssize_t written = write(client.out, client.output.data() + client.sent,
+								client.output.size() - client.sent);
+		if (written > 0)
+		{
+			client.sent += written;
+			continue;
+		}
+		if (written < 0 && errno == EINTR)
+			continue;
+		return written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+	client.output.clear();
+	client.sent = 0;
+	return true;
+}
+
+// Reads while the client keeps up with its answers, waits for the socket
+// to drain when some are left, and closes once everything is answered
+void QueryServer::update(Client &client)
+{
+	size_t pending = client.output.size() - client.sent;
+	if (client.ended && pending == 0)
+	{
+		closeClient(client);
+		return;
+	}
+	unsigned int wanted = 0;
+	if (!client.ended && pending < SERVER_OUTPUT_LIMIT)
+		wanted |= EPOLLIN;
+	if (pending > 0)
+		wanted |= EPOLLOUT;
+	if (wanted == client.events)
+		return;
+
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = wanted;
+	event.data.ptr = &client;
+	if (epoll_ctl(_epoll, EPOLL_CTL_MOD, client.in, &event) == 0)
+		client.events = wanted;
+}
+
+void QueryServer::closeClient(Client &client)
+{
+	epoll_ctl(_epoll, EPOLL_CTL_DEL, client.in, NULL);
+	close(client.in);
+	_clients.erase(client.in);
+	delete &client;
+}
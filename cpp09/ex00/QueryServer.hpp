@@ -0,0 +1,83 @@
+#ifndef QUERYSERVER_HPP
+#define QUERYSERVER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include "ChunkProcessor.hpp"
+
+// Bytes taken from a client per read; whole lines among them make a batch
+#define SERVER_READ_BYTES 65536
+
+// Events handled per epoll_wait
+#define SERVER_MAX_EVENTS 64
+
+// A client with this many answers it has not read yet is not read from
+// until it catches up
+#define SERVER_OUTPUT_LIMIT (1 << 20)
+
+// Longest line a client may send; past it the client gets an error and is
+// closed, rather than its input growing until a newline comes
+#define SERVER_LINE_LIMIT 4096
+
+// Line-oriented request server on one thread. Clients connect to a Unix
+// domain socket and may send any number of lines without waiting; the
+// whole lines of each read go to the handler as one batch, and its output
+// goes back on the same connection, so answers are pipelined and come in
+// request order. All clients share one epoll loop, with non-blocking
+// sockets. Serving "-" answers stdin on stdout instead: a single client
+// has nothing to multiplex (and epoll does not take regular files), so it
+// is read with plain blocking reads, batch by batch.
+class QueryServer
+{
+private:
+	QueryServer(const QueryServer &other);
+	QueryServer &operator=(const QueryServer &other);
+
+public:
+	// Answers the lines in [begin, end) into `output`, errors included
+	typedef ChunkProcessor::Task Handler;
+
+	QueryServer(Handler handler, void *context);
+	~QueryServer();
+
+	// Listens on a Unix domain socket at `path` (a stale socket there is
+	// replaced), or prepares to serve stdin for "-"
+	bool open(const std::string &path, std::string &error);
+	// Serves until SIGINT or SIGTERM, or until stdin ends
+	void run();
+
+private:
+	struct Client
+	{
+		int in;
+		int out;					// same as `in` for a socket
+		std::vector<char> input;	// received, not yet answered
+		std::string output;			// answered, not yet sent
+		size_t sent;
+		bool ended;					// nothing more will be read
+		unsigned int events;		// what epoll watches
+	};
+
+	Handler _handler;
+	void *_context;
+	std::string _path;
+	int _listener;
+	int _epoll;
+	std::map<int, Client *> _clients;
+	std::vector<char> _buffer;		// one read, before it joins a client's input
+
+	void servePipe();
+	void acceptClients();
+	bool receive(Client &client);
+	void answer(Client &client);
+	bool flush(Client &client);
+	void update(Client &client);
+	void closeClient(Client &client);
+	static bool inUse(const std::string &path);
+	static void installSignals();
+};
+
+#endif
@@ -0,0 +1,582 @@
+#include "RateIndex.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+// Snapshot layout: this header, then the dates, rates, tree, ranks and
+// calendar, each a plain array of 4-byte values as they are in memory.
+// The checksum (see Checksum) covers everything after the header.
+struct SnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;			// BYTE_ORDER_MARK as the writer stored it
+	uint64_t count;				// dates; the tree and ranks have one more slot
+	uint64_t calendarSize;
+	int32_t firstDay;
+	uint32_t reserved;
+	uint64_t checksum;
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'B', 'T', 'C', 'R', 'A', 'T', 'E', 'S'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Arrays are written and mapped as they are, so their elements must be
+// the 4-byte values the header promises, and the arrays stay aligned
+typedef char SnapshotElementsAreFourBytes[(sizeof(int) == 4 && sizeof(float) == 4
+										   && sizeof(unsigned int) == 4) ? 1 : -1];
+typedef char SnapshotHeaderIsPacked[(sizeof(SnapshotHeader) == 48) ? 1 : -1];
+
+#define CHECKSUM_LANES 4
+
+// FNV-1a over 32-bit words (every section is made of them), dealt round
+// robin to independent lanes so the multiplications overlap, then the
+// lanes folded into one hash. A section boundary never splits a word, so
+// hashing the sections one after another gives the hash of the whole
+// payload as it lies in the file.
+class Checksum
+{
+public:
+	Checksum() : _next(0)
+	{
+		for (size_t i = 0; i < CHECKSUM_LANES; ++i)
+			_lanes[i] = 14695981039346656037ULL + i;
+	}
+
+	void add(const void *data, size_t length)
+	{
+		const char *bytes = static_cast<const char *>(data);
+		const char *end = bytes + length / 4 * 4;
+		while (bytes < end && _next != 0)
+			mix(bytes);
+		// Whole rounds, one word per lane
+		while (end - bytes >= 4 * CHECKSUM_LANES)
+		{
+			for (size_t i = 0; i < CHECKSUM_LANES; ++i)
+				mix(bytes);
+		}
+		while (bytes < end)
+			mix(bytes);
+	}
+
+	uint64_t value() const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < CHECKSUM_LANES; ++i)
+			hash = (hash ^ _lanes[i]) * 1099511628211ULL;
+		return hash;
+	}
+
+private:
+	uint64_t _lanes[CHECKSUM_LANES];
+	size_t _next;
+
+	void mix(const char *&bytes)
+	{
+		uint32_t word;
+		std::memcpy(&word, bytes, 4);
+		bytes += 4;
+		_lanes[_next] = (_lanes[_next] ^ word) * 1099511628211ULL;
+		_next = (_next + 1) % CHECKSUM_LANES;
+	}
+};
+
+template <typename T>
+static const T *arrayOf(const std::vector<T> &values)
+{
+	return values.empty() ? NULL : &values[0];
+}
+
+RateIndex::RateIndex()
+	: _firstDay(0), _dateView(NULL), _rateView(NULL), _treeView(NULL), _rankView(NULL),
+	  _calendarView(NULL), _count(0), _calendarSize(0), _snapshot(NULL)
+{}
+
+RateIndex::RateIndex(const RateIndex &other)
+	: _firstDay(0), _dateView(NULL), _rateView(NULL), _treeView(NULL), _rankView(NULL),
+	  _calendarView(NULL), _count(0), _calendarSize(0), _snapshot(NULL)
+{
+	*this = other;
+}
+
+// A copy owns its arrays, also when `other` reads a snapshot
+RateIndex &RateIndex::operator=(const RateIndex &other)
+{
+	if (this != &other)
+	{
+		release();
+		if (other._snapshot == NULL)
+		{
+			_dates = other._dates;
+			_rates = other._rates;
+			_tree = other._tree;
+			_rank = other._rank;
+			_calendar = other._calendar;
+		}
+		else
+		{
+			size_t n = other._count;
+			_dates.assign(other._dateView, other._dateView + n);
+			_rates.assign(other._rateView, other._rateView + n);
+			_tree.assign(other._treeView, other._treeView + n + 1);
+			_rank.assign(other._rankView, other._rankView + n + 1);
+			_calendar.assign(other._calendarView, other._calendarView + other._calendarSize);
+		}
+		_firstDay = other._firstDay;
+		attach();
+	}
+	return *this;
+}
+
+RateIndex::~RateIndex()
+{
+	release();
+}
+
+// Points the views at the arrays this index owns
+void RateIndex::attach()
+{
+	_dateView = arrayOf(_dates);
+	_rateView = arrayOf(_rates);
+	_treeView = arrayOf(_tree);
+	_rankView = arrayOf(_rank);
+	_calendarView = arrayOf(_calendar);
+	_count = _dates.size();
+	_calendarSize = _calendar.size();
+}
+
+void RateIndex::release()
+{
+	delete _snapshot;
+	_snapshot = NULL;
+}
+
+int RateIndex::packDate(int year, int month, int day)
+{
+	return year * 10000 + month * 100 + day;
+}
+
+// Counts days from 1 March of year 0, so that the leap day comes last in
+// its year, then shifts the origin to 1970-01-01
+int RateIndex::dayNumber(int year, int month, int day)
+{
+	if (month <= 2)
+		year--;
+	int era = (year >= 0 ? year : year - 399) / 400;
+	int yearOfEra = year - era * 400;
+	int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+static int dayOfDate(int date)
+{
+	return RateIndex::dayNumber(date / 10000, date / 100 % 100, date % 100);
+}
+
+static bool isCalendarDate(int date)
+{
+	int year = date / 10000;
+	int month = date / 100 % 100;
+	int day = date % 100;
+	static const int DAYS_IN_MONTH[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+	if (month < 1 || month > 12 || day < 1)
+		return false;
+	bool isLeap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+	return day <= DAYS_IN_MONTH[month - 1] + (month == 2 && isLeap);
+}
+
+void RateIndex::insert(int date, float rate)
+{
+	// A mapped snapshot is read-only; take a private copy to add to
+	if (_snapshot != NULL)
+		*this = RateIndex(*this);
+	_dates.push_back(date);
+	_rates.push_back(rate);
+}
+
+// Sorts what was inserted (data.csv is normally sorted already, which is
+// checked first), keeps the last rate of each date and lays out the tree
+void RateIndex::build()
+{
+	if (_snapshot != NULL)
+		return;
+	size_t n = _dates.size();
+	bool sorted = true;
+	for (size_t i = 1; i < n && sorted; ++i)
+		sorted = (_dates[i - 1] <= _dates[i]);
+	if (!sorted)
+	{
+		// Sorting (date, insertion order) pairs keeps duplicates in order
+		std::vector<std::pair<int, size_t> > order(n);
+		for (size_t i = 0; i < n; ++i)
+			order[i] = std::make_pair(_dates[i], i);
+		std::sort(order.begin(), order.end());
+		std::vector<float> rates(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			_dates[i] = order[i].first;
+			rates[i] = _rates[order[i].second];
+		}
+		_rates.swap(rates);
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (kept > 0 && _dates[kept - 1] == _dates[i])
+			--kept;
+		_dates[kept] = _dates[i];
+		_rates[kept] = _rates[i];
+		++kept;
+	}
+	_dates.resize(kept);
+	_rates.resize(kept);
+
+	_tree.assign(kept + 1, 0);
+	_rank.assign(kept + 1, 0);
+	layout(0, 1);
+	buildCalendar();
+	attach();
+}
+
+// One slot per day from the first date to the last, each holding the rate
+// of the latest date on or before it. Dates that are not real calendar
+// dates (data.csv is only checked for digits) have no slot, so their
+// presence keeps the index search-only.
+void RateIndex::buildCalendar()
+{
+	_calendar.clear();
+	size_t n = _dates.size();
+	if (n == 0)
+		return;
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (!isCalendarDate(_dates[i]))
+			return;
+	}
+	_firstDay = dayOfDate(_dates[0]);
+	size_t span = dayOfDate(_dates[n - 1]) - _firstDay + 1;
+	if (span > CALENDAR_DENSITY * n)
+		return;
+
+	_calendar.resize(span);
+	size_t slot = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		size_t next = (i + 1 < n) ? dayOfDate(_dates[i + 1]) - _firstDay : span;
+		while (slot < next)
+			_calendar[slot++] = _rates[i];
+	}
+}
+
+// In-order walk of the implicit tree (children of node k are 2k and
+// 2k + 1) handing out the sorted dates one by one
+size_t RateIndex::layout(size_t next, size_t node)
+{
+	if (node < _tree.size())
+	{
+		next = layout(next, 2 * node);
+		_tree[node] = _dates[next];
+		_rank[node] = static_cast<unsigned int>(next);
+		next = layout(next + 1, 2 * node + 1);
+	}
+	return next;
+}
+
+// Number of dates on or before `date`, through the Eytzinger tree
+size_t RateIndex::countUpTo(int date) const
+{
+	size_t n = _count;
+	if (n == 0)
+		return 0;
+
+	// Descend to a leaf, going right past every date <= `date`; the slot
+	// right after the last left turn holds the first date that is later
+	const int *tree = _treeView;
+	size_t k = 1;
+	while (k <= n)
+	{
+#if defined(__GNUC__)
+		// The 16 great-great-grandchildren of k share one cache line
+		__builtin_prefetch(tree + 16 * k);
+#endif
+		k = 2 * k + (tree[k] <= date);
+	}
+	while (k & 1)
+		k >>= 1;
+	k >>= 1;
+
+	return (k == 0) ? n : _rankView[k];
+}
+
+bool RateIndex::find(int date, float &rate) const
+{
+	size_t later = countUpTo(date);
+	if (later == 0)
+		return false;
+	rate = _rateView[later - 1];
+	return true;
+}
+
+bool RateIndex::findEntry(int date, int &entryDate, float &rate) const
+{
+	size_t later = countUpTo(date);
+	if (later == 0)
+		return false;
+	entryDate = _dateView[later - 1];
+	rate = _rateView[later - 1];
+	return true;
+}
+
+bool RateIndex::lookup(int year, int month, int day, float &rate) const
+{
+	if (_calendarSize == 0)
+		return find(packDate(year, month, day), rate);
+
+	int slot = dayNumber(year, month, day) - _firstDay;
+	if (slot < 0)
+		return false;
+	if (static_cast<size_t>(slot) >= _calendarSize)
+		slot = static_cast<int>(_calendarSize) - 1;
+	rate = _calendarView[slot];
+	return true;
+}
+
+// First position from `from` on whose date is later than `date`, given
+// that every date before `from` is not: steps of 1, 2, 4... bracket it,
+// then a binary search inside the last step finds it
+size_t RateIndex::gallop(size_t from, int date) const
+{
+	size_t low = from;
+	size_t high = from;
+	size_t step = 1;
+	while (high < _count && _dateView[high] <= date)
+	{
+		low = high + 1;
+		high += step;
+		step *= 2;
+	}
+	if (high > _count)
+		high = _count;
+	return std::upper_bound(_dateView + low, _dateView + high, date) - _dateView;
+}
+
+void RateIndex::lookupBatch(BatchQuery *queries, size_t count) const
+{
+	if (_calendarSize != 0)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			int date = queries[i].date;
+			queries[i].found = lookup(date / 10000, date / 100 % 100, date % 100, queries[i].rate);
+		}
+		return;
+	}
+
+	bool sorted = true;
+	for (size_t i = 1; i < count && sorted; ++i)
+		sorted = (queries[i - 1].date <= queries[i].date);
+	if (!sorted && _count < BATCH_SORT_MIN_DATES)
+	{
+		for (size_t i = 0; i < count; ++i)
+			queries[i].found = find(queries[i].date, queries[i].rate);
+		return;
+	}
+
+	std::vector<std::pair<int, size_t> > order;
+	if (!sorted)
+	{
+		order.resize(count);
+		for (size_t i = 0; i < count; ++i)
+			order[i] = std::make_pair(queries[i].date, i);
+		std::sort(order.begin(), order.end());
+	}
+
+	size_t later = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		BatchQuery &query = sorted ? queries[i] : queries[order[i].second];
+		later = gallop(later, query.date);
+		query.found = (later > 0);
+		if (query.found)
+			query.rate = _rateView[later - 1];
+	}
+}
+
+bool RateIndex::hasCalendar() const
+{
+	return _calendarSize != 0;
+}
+
+size_t RateIndex::size() const
+{
+	return _count;
+}
+
+size_t RateIndex::memoryBytes() const
+{
+	return _dates.capacity() * sizeof(int) + _rates.capacity() * sizeof(float)
+		+ _tree.capacity() * sizeof(int) + _rank.capacity() * sizeof(unsigned int)
+		+ _calendar.capacity() * sizeof(float)
+		+ ((_snapshot != NULL) ? _snapshot->size() : 0);
+}
+
+bool RateIndex::save(const std::string &path, std::string &error) const
+{
+	if (_treeView == NULL)
+	{
+		error = "the index is not built";
+		return false;
+	}
+
+	SnapshotHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.byteOrder = BYTE_ORDER_MARK;
+	header.count = _count;
+	header.calendarSize = _calendarSize;
+	header.firstDay = _firstDay;
+
+	const void *sections[] = {_dateView, _rateView, _treeView, _rankView, _calendarView};
+	const size_t lengths[] = {
+		_count * 4, _count * 4, (_count + 1) * 4, (_count + 1) * 4, _calendarSize * 4
+	};
+	const size_t sectionCount = sizeof(lengths) / sizeof(lengths[0]);
+	Checksum checksum;
+	for (size_t i = 0; i < sectionCount; ++i)
+		checksum.add(sections[i], lengths[i]);
+	header.checksum = checksum.value();
+
+	std::string temporary = path + ".tmp";
+	std::ofstream out(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		error = "cannot create " + temporary;
+		return false;
+	}
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	for (size_t i = 0; i < sectionCount; ++i)
+	{
+		if (lengths[i] > 0)
+			out.write(static_cast<const char *>(sections[i]), lengths[i]);
+	}
+	out.close();
+	if (!out)
+	{
+		std::remove(temporary.c_str());
+		error = "cannot write " + temporary;
+		return false;
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		error = "cannot replace " + path;
+		return false;
+	}
+	return true;
+}
+
+// The checksum only catches accidents, so what lookups use as an index is
+// checked as well: every rank must name a date, and a calendar must span
+// the first date to the last, no sparser than build() would allow
+static bool snapshotConsistent(const SnapshotHeader &header, const char *payload)
+{
+	size_t count = header.count;
+	const int *dates = reinterpret_cast<const int *>(payload);
+	const unsigned int *ranks = reinterpret_cast<const unsigned int *>(payload + (3 * count + 1) * 4);
+	for (size_t k = 1; k <= count; ++k)
+	{
+		if (ranks[k] >= count)
+			return false;
+	}
+
+	if (header.calendarSize == 0)
+		return true;
+	if (count == 0 || header.calendarSize > CALENDAR_DENSITY * static_cast<uint64_t>(count)
+		|| !isCalendarDate(dates[0]) || !isCalendarDate(dates[count - 1])
+		|| header.firstDay != dayOfDate(dates[0]))
+		return false;
+	int64_t span = static_cast<int64_t>(dayOfDate(dates[count - 1])) - header.firstDay + 1;
+	return span == static_cast<int64_t>(header.calendarSize);
+}
+
+// Everything is checked before anything is used: the file must be a
+// snapshot of this version and byte order, exactly as long as its header
+// says, match its checksum and hold indices that stay in range. Those two
+// passes are the only work that grows with the table, and they only read.
+bool RateIndex::load(const std::string &path, std::string &error)
+{
+	MappedFile *file = new MappedFile;
+	if (!file->open(path, MappedFile::RESIDENT))
+	{
+		delete file;
+		error = "cannot open " + path;
+		return false;
+	}
+
+	const char *data = file->data();
+	size_t size = file->size();
+	SnapshotHeader header;
+	if (size >= sizeof(header))
+		std::memcpy(&header, data, sizeof(header));
+	if (size < sizeof(header) || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+		error = path + " is not a rate snapshot";
+	else if (header.byteOrder != BYTE_ORDER_MARK)
+		error = path + " was written with another byte order";
+	else if (header.version != SNAPSHOT_VERSION)
+		error = path + " has an unsupported version";
+	else
+	{
+		uint64_t payload = size - sizeof(header);
+		if (header.count > payload / 16 || header.calendarSize > payload / 4
+			|| payload != (4 * header.count + 2 + header.calendarSize) * 4)
+			error = path + " is truncated or has trailing data";
+		else
+		{
+			Checksum checksum;
+			checksum.add(data + sizeof(header), payload);
+			if (checksum.value() != header.checksum)
+				error = path + " is corrupt (checksum mismatch)";
+			else if (!snapshotConsistent(header, data + sizeof(header)))
+				error = path + " is corrupt (index out of range)";
+		}
+	}
+	if (!error.empty())
+	{
+		delete file;
+		return false;
+	}
+
+	// Drop what this index held and read the mapped arrays instead
+	release();
+	std::vector<int>().swap(_dates);
+	std::vector<float>().swap(_rates);
+	std::vector<int>().swap(_tree);
+	std::vector<unsigned int>().swap(_rank);
+	std::vector<float>().swap(_calendar);
+	_snapshot = file;
+	_count = header.count;
+	_calendarSize = header.calendarSize;
+	_firstDay = header.firstDay;
+
+	const char *section = data + sizeof(header);
+	_dateView = reinterpret_cast<const int *>(section);
+	section += _count * 4;
+	_rateView = reinterpret_cast<const float *>(section);
+	section += _count * 4;
+	_treeView = reinterpret_cast<const int *>(section);
+	section += (_count + 1) * 4;
+	_rankView = reinterpret_cast<const unsigned int *>(section);
+	section += (_count + 1) * 4;
+	_calendarView = (_calendarSize > 0) ? reinterpret_cast<const float *>(section) : NULL;
+	return true;
+}
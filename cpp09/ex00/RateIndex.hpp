@@ -0,0 +1,108 @@
+#ifndef RATEINDEX_HPP
+#define RATEINDEX_HPP
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+class MappedFile;
+
+// The calendar table is built when it has at most this many days per date
+// in the index; sparser databases are only searched
+#define CALENDAR_DENSITY 8
+
+// A batch of queries in no particular order is sorted before it is merged
+// against the dates only from this many dates on; a smaller index stays in
+// cache, and searching it once per query is cheaper than sorting
+#define BATCH_SORT_MIN_DATES (1 << 16)
+
+// Exchange rates keyed by packed dates (year * 10000 + month * 100 + day),
+// which sort exactly like the "YYYY-MM-DD" strings they come from.
+// Keys and rates are kept in two sorted parallel arrays; lookups search a
+// copy of the keys laid out in Eytzinger (breadth-first) order, where the
+// first levels of every search share a few cache lines and the next ones
+// can be prefetched. When the dates are dense enough, a calendar table with
+// one slot per day, forward-filled with the latest rate on or before that
+// day, answers lookups by a calendar date with a single load.
+// A built index can be saved as a snapshot file holding these arrays as
+// they are in memory; load() maps one and searches it in place, so nothing
+// is parsed, sorted or laid out again.
+class RateIndex
+{
+public:
+	RateIndex();
+	RateIndex(const RateIndex &other);
+	RateIndex &operator=(const RateIndex &other);
+	~RateIndex();
+
+	static int packDate(int year, int month, int day);
+	// Days since 1970-01-01 in the proleptic Gregorian calendar
+	static int dayNumber(int year, int month, int day);
+
+	// Adds a rate; when a date is inserted twice the later rate wins.
+	// Call build() once everything is in, before the first lookup.
+	void insert(int date, float rate);
+	void build();
+
+	// Rate of the latest date on or before `date`; false when every date
+	// in the index is later
+	bool find(int date, float &rate) const;
+	// Same, also giving the date the rate belongs to
+	bool findEntry(int date, int &entryDate, float &rate) const;
+	// Same for a valid calendar date, through the calendar table if there
+	// is one
+	bool lookup(int year, int month, int day, float &rate) const;
+	bool hasCalendar() const;
+
+	// One query of a batch: a calendar date in, its answer out
+	struct BatchQuery
+	{
+		int date;			// packed
+		float rate;
+		bool found;			// what lookup() would return
+	};
+	// Answers a block of queries together. Without a calendar table the
+	// dates are taken in order (sorted first if they are not, remembering
+	// where each came from) and merged against the sorted dates with a
+	// galloping cursor, so each search starts where the last one ended.
+	// With a calendar table every query is a single load anyway, and an
+	// unsorted batch against a small index is searched query by query.
+	void lookupBatch(BatchQuery *queries, size_t count) const;
+
+	size_t size() const;
+	size_t memoryBytes() const;
+
+	// Writes the built index to `path` (through a temporary file renamed
+	// over it, so a reader never sees half a snapshot)
+	bool save(const std::string &path, std::string &error) const;
+	// Replaces the index with the snapshot at `path`, used where it is
+	// mapped; on failure `error` says why and the index is left as it was
+	bool load(const std::string &path, std::string &error);
+
+private:
+	std::vector<int> _dates;
+	std::vector<float> _rates;
+	std::vector<int> _tree;				// _dates in Eytzinger order, from 1
+	std::vector<unsigned int> _rank;	// position in _dates of each _tree slot
+	std::vector<float> _calendar;		// rate by day, from the first date's day
+	int _firstDay;
+
+	// What lookups read: the arrays above, or those of a mapped snapshot
+	const int *_dateView;
+	const float *_rateView;
+	const int *_treeView;
+	const unsigned int *_rankView;
+	const float *_calendarView;
+	size_t _count;
+	size_t _calendarSize;
+	MappedFile *_snapshot;
+
+	void attach();
+	void release();
+	size_t countUpTo(int date) const;
+	size_t gallop(size_t from, int date) const;
+	size_t layout(size_t next, size_t node);
+	void buildCalendar();
+};
+
+#endif
@@ -0,0 +1,402 @@
+// Load generator for "./btc --serve SOCKET". Each connection runs on its
+// own thread and keeps a window of queries in flight: it writes `depth`
+// lines, reads their `depth` answers, and starts over until its share of
+// the queries is answered. The latency of a query runs from the write of
+// its window to the read that brought its answer.
+//
+// "./btc_load --live" stresses LiveRates in process instead: reader threads
+// keep opening LiveRates::Reader views and checking their answers while the
+// main thread appends rates, so tail appends, index rebuilds and version
+// reclamation all run under concurrent lookups.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "LiveRates.hpp"
+
+// Distinct query lines each connection cycles through
+#define QUERY_POOL 4096
+
+// Lookups a --live reader makes in each view it opens
+#define LIVE_PROBES 16
+
+struct Connection
+{
+	std::string path;
+	size_t queries;
+	size_t depth;
+	unsigned int seed;
+	std::vector<double> latencies;	// microseconds, one per answer
+	size_t errors;					// answers starting with "Error"
+	bool failed;
+};
+
+static double monotonicUs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+// Dates from 2010 to 2022 (days up to 28, so every one is valid and has a
+// rate) and values in range, with a few decimals
+static std::vector<std::string> makeQueries(unsigned int &seed)
+{
+	std::vector<std::string> queries(QUERY_POOL);
+	for (size_t i = 0; i < queries.size(); ++i)
+	{
+		char line[64];
+		sprintf(line, "%04d-%02d-%02d | %d.%02d\n", 2010 + rand_r(&seed) % 13,
+				1 + rand_r(&seed) % 12, 1 + rand_r(&seed) % 28, rand_r(&seed) % 1000,
+				rand_r(&seed) % 100);
+		queries[i] = line;
+	}
+	return queries;
+}
+
+static int connectTo(const std::string &path)
+{
+	struct sockaddr_un address;
+	if (path.size() >= sizeof(address.sun_path))
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path.c_str());
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool writeAll(int fd, const std::string &text)
+{
+	size_t done = 0;
+	while (done < text.size())
+	{
+		ssize_t n = write(fd, text.data() + done, text.size() - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+static void *runConnection(void *argument)
+{
+	Connection &connection = *static_cast<Connection *>(argument);
+	std::vector<std::string> pool = makeQueries(connection.seed);
+	int fd = connectTo(connection.path);
+	if (fd < 0)
+	{
+		connection.failed = true;
+		return NULL;
+	}
+
+	std::string window;
+	std::vector<char> buffer(65536);
+	bool lineStart = true;
+	size_t next = 0;
+	while (connection.latencies.size() < connection.queries)
+	{
+		// STEP 1: one window of queries in a single write
+		size_t count = std::min(connection.depth,
+								connection.queries - connection.latencies.size());
+		window.clear();
+		for (size_t i = 0; i < count; ++i)
+			window += pool[next++ % pool.size()];
+		double sent = monotonicUs();
+		if (!writeAll(fd, window))
+			break;
+
+		// STEP 2: its answers, one line each
+		size_t answered = 0;
+		while (answered < count)
+		{
+			ssize_t got = read(fd, &buffer[0], buffer.size());
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got <= 0)
+				break;
+			double arrived = monotonicUs() - sent;
+			for (ssize_t i = 0; i < got; ++i)
+			{
+				if (lineStart && buffer[i] == 'E')
+					connection.errors++;
+				lineStart = (buffer[i] == '\n');
+				if (lineStart)
+				{
+					connection.latencies.push_back(arrived);
+					answered++;
+				}
+			}
+		}
+		if (answered < count)
+			break;
+	}
+	close(fd);
+	connection.failed = connection.latencies.size() < connection.queries;
+	return NULL;
+}
+
+// Day `day` of a made-up calendar of 28-day months, so every date is valid;
+// the --live rates give each day its own number as its rate, which a float
+// holds exactly
+static int liveDate(size_t day)
+{
+	return RateIndex::packDate(2000 + static_cast<int>(day / 336),
+							   1 + static_cast<int>(day / 28 % 12), 1 + static_cast<int>(day % 28));
+}
+
+struct LiveStress
+{
+	LiveRates *rates;
+	size_t days;				// days the rates will hold in the end
+	volatile size_t appended;	// days append() has returned for
+	volatile bool done;
+};
+
+struct LiveReader
+{
+	LiveStress *stress;
+	unsigned int seed;
+	size_t views;
+	size_t lookups;
+	size_t wrong;
+};
+
+// Every view must hold at least the days appended before it was opened,
+// answer each of them with its own number, and keep the same latest day
+// for as long as it is open
+static void *runLiveReader(void *argument)
+{
+	LiveReader &reader = *static_cast<LiveReader *>(argument);
+	LiveStress &stress = *reader.stress;
+	RateIndex::BatchQuery batch[LIVE_PROBES];
+	int last = liveDate(stress.days);
+	while (!stress.done)
+	{
+		size_t before = stress.appended;
+		__sync_synchronize();
+		LiveRates::Reader view(*stress.rates);
+		float rate;
+		if (!view.find(last, rate) || rate < before - 1)
+		{
+			reader.wrong++;
+			continue;
+		}
+		size_t visible = static_cast<size_t>(rate) + 1;
+		for (size_t i = 0; i < LIVE_PROBES; ++i)
+		{
+			size_t day = rand_r(&reader.seed) % visible;
+			batch[i].date = liveDate(day);
+			float found;
+			if (!view.find(batch[i].date, found) || found != day)
+				reader.wrong++;
+		}
+		view.lookupBatch(batch, LIVE_PROBES);
+		for (size_t i = 0; i < LIVE_PROBES; ++i)
+		{
+			if (!batch[i].found || liveDate(static_cast<size_t>(batch[i].rate)) != batch[i].date)
+				reader.wrong++;
+		}
+		if (!view.find(last, rate) || rate != visible - 1)
+			reader.wrong++;
+		reader.views++;
+		reader.lookups += 2 * LIVE_PROBES + 2;
+	}
+	return NULL;
+}
+
+// Publishes the first `based` days as an index, then appends the rest one
+// by one while `readers` threads read
+static int runLive(size_t based, size_t appends, size_t readers)
+{
+	RateIndex *index = new RateIndex;
+	for (size_t day = 0; day < based; ++day)
+		index->insert(liveDate(day), static_cast<float>(day));
+	index->build();
+	LiveRates rates;
+	rates.publish(index);
+
+	LiveStress stress;
+	stress.rates = &rates;
+	stress.days = based + appends;
+	stress.appended = based;
+	stress.done = false;
+	std::vector<LiveReader> states(readers);
+	std::vector<pthread_t> threads(readers);
+	size_t started = 0;
+	for (; started < readers; ++started)
+	{
+		states[started].stress = &stress;
+		states[started].seed = 12345 + static_cast<unsigned int>(started);
+		states[started].views = 0;
+		states[started].lookups = 0;
+		states[started].wrong = 0;
+		if (pthread_create(&threads[started], NULL, runLiveReader, &states[started]) != 0)
+			break;
+	}
+
+	double start = monotonicUs();
+	for (size_t day = based; day < stress.days; ++day)
+	{
+		rates.append(liveDate(day), static_cast<float>(day));
+		__sync_synchronize();
+		stress.appended = day + 1;
+	}
+	double elapsed = monotonicUs() - start;
+	stress.done = true;
+	__sync_synchronize();
+
+	size_t views = 0;
+	size_t lookups = 0;
+	size_t wrong = 0;
+	for (size_t i = 0; i < started; ++i)
+	{
+		pthread_join(threads[i], NULL);
+		views += states[i].views;
+		lookups += states[i].lookups;
+		wrong += states[i].wrong;
+	}
+
+	// Once the writer is done every day answers with its own number
+	LiveRates::Reader view(rates);
+	for (size_t day = 0; day < stress.days; ++day)
+	{
+		float rate;
+		if (!view.find(liveDate(day), rate) || rate != day)
+			wrong++;
+	}
+
+	printf("Appends:    %lu after %lu published rates, %lu index rebuilds (%.3f s)\n",
+		   static_cast<unsigned long>(appends), static_cast<unsigned long>(based),
+		   static_cast<unsigned long>(appends / LIVE_TAIL_CAPACITY), elapsed / 1e6);
+	printf("Readers:    %lu threads, %lu views, %lu lookups, %lu wrong answers\n",
+		   static_cast<unsigned long>(started), static_cast<unsigned long>(views),
+		   static_cast<unsigned long>(lookups), static_cast<unsigned long>(wrong));
+	if (started < readers)
+		std::cerr << "Error: could not start every reader thread." << std::endl;
+	return (wrong == 0 && started == readers) ? 0 : 1;
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+	size_t rank = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+	return sorted[rank];
+}
+
+static bool readCount(const char *text, size_t &value)
+{
+	char *end;
+	long number = std::strtol(text, &end, 10);
+	if (*end != '\0' || number < 1)
+		return false;
+	value = static_cast<size_t>(number);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	size_t queries = 200000;
+	size_t connections = 4;
+	size_t depth = 32;
+	size_t based = 4096;
+	size_t appends = 20000;
+	size_t readers = 4;
+
+	bool valid = argc >= 2 && argc % 2 == 0;
+	bool live = valid && std::string(argv[1]) == "--live";
+	for (int i = 2; valid && i < argc; i += 2)
+	{
+		std::string option(argv[i]);
+		if (!live && option == "--queries")
+			valid = readCount(argv[i + 1], queries);
+		else if (!live && option == "--connections")
+			valid = readCount(argv[i + 1], connections);
+		else if (!live && option == "--depth")
+			valid = readCount(argv[i + 1], depth);
+		else if (live && option == "--rates")
+			valid = readCount(argv[i + 1], based);
+		else if (live && option == "--appends")
+			valid = readCount(argv[i + 1], appends);
+		else if (live && option == "--readers")
+			valid = readCount(argv[i + 1], readers);
+		else
+			valid = false;
+	}
+	if (!valid)
+	{
+		std::cerr << "Usage: ./btc_load <socket> [--queries N] [--connections C] [--depth D]\n"
+				  << "       ./btc_load --live [--rates N] [--appends N] [--readers R]"
+				  << std::endl;
+		return 1;
+	}
+	if (live)
+		return runLive(based, appends, readers);
+
+	std::vector<Connection> states(connections);
+	for (size_t i = 0; i < connections; ++i)
+	{
+		states[i].path = argv[1];
+		states[i].queries = queries / connections + (i < queries % connections);
+		states[i].depth = depth;
+		states[i].seed = 12345 + static_cast<unsigned int>(i);
+		states[i].errors = 0;
+		states[i].failed = false;
+		states[i].latencies.reserve(states[i].queries);
+	}
+
+	std::vector<pthread_t> threads(connections);
+	double start = monotonicUs();
+	size_t started = 0;
+	while (started < connections
+		   && pthread_create(&threads[started], NULL, runConnection, &states[started]) == 0)
+		++started;
+	for (size_t i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+	double elapsed = monotonicUs() - start;
+
+	std::vector<double> latencies;
+	size_t errors = 0;
+	bool failed = started < connections;
+	for (size_t i = 0; i < started; ++i)
+	{
+		latencies.insert(latencies.end(), states[i].latencies.begin(),
+						 states[i].latencies.end());
+		errors += states[i].errors;
+		failed = failed || states[i].failed;
+	}
+	if (failed)
+		std::cerr << "Error: connection to " << argv[1] << " failed or closed early." << std::endl;
+	if (latencies.empty())
+		return 1;
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("Queries:    %lu answered over %lu connections, %lu in flight on each (%lu errors)\n",
+		   static_cast<unsigned long>(latencies.size()), static_cast<unsigned long>(started),
+		   static_cast<unsigned long>(depth), static_cast<unsigned long>(errors));
+	printf("Throughput: %.0f queries/s (%.3f s)\n", latencies.size() / (elapsed / 1e6),
+		   elapsed / 1e6);
+	printf("Latency:    p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+		   percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+		   percentile(latencies, 0.999), latencies.back());
+	return failed ? 1 : 0;
+}
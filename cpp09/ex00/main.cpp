@@ -1,16 +1,60 @@
 #include "BitcoinExchange.hpp"
+#include <cstdlib>
 
 int main(int argc, char **argv)
 {
-	if (argc != 2)
+	BitcoinExchange btc;
+
+	// "--compile DATABASE SNAPSHOT" validates a database and saves it as a
+	// snapshot that later runs load with "--snapshot SNAPSHOT"
+	if (argc == 4 && std::string(argv[1]) == "--compile")
+	{
+		btc.readData(argv[2]);
+		btc.writeSnapshot(argv[3]);
+		return 0;
+	}
+
+	// Optional leading "--threads N", "--snapshot FILE" and "--serve SOCKET"
+	const char *snapshot = NULL;
+	const char *serveOn = NULL;
+	while (argc > 2)
+	{
+		std::string option(argv[1]);
+		if (option == "--threads")
+		{
+			long threads = std::atol(argv[2]);
+			if (threads < 1)
+			{
+				std::cerr << "Error: --threads needs a positive count." << std::endl;
+				return 1;
+			}
+			btc.setThreads(static_cast<size_t>(threads));
+		}
+		else if (option == "--snapshot")
+			snapshot = argv[2];
+		else if (option == "--serve")
+			serveOn = argv[2];
+		else
+			break;
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc != (serveOn != NULL ? 1 : 2))
 	{
-		std::cerr << "Usage: ./btc <filename>" << std::endl;
+		std::cerr << "Usage: ./btc [--threads N] [--snapshot FILE] <filename>" << std::endl;
+		std::cerr << "       ./btc [--snapshot FILE] --serve <socket|->" << std::endl;
+		std::cerr << "       ./btc --compile <database.csv> <snapshot>" << std::endl;
 		return 1;
 	}
 
-	BitcoinExchange btc;
-	btc.readData();
-	btc.processInput(argv[1]);
+	if (snapshot != NULL)
+		btc.loadSnapshot(snapshot);
+	else
+		btc.readData();
+	if (serveOn != NULL)
+		btc.serve(serveOn);
+	else
+		btc.processInput(argv[1]);
 
 	return 0;
 }
\ No newline at end of file
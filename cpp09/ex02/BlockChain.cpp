@@ -0,0 +1,124 @@
+#include "BlockChain.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+BlockChain::BlockChain() : _blocks(0), _length(0) {}
+
+BlockChain::BlockChain(size_t capacity) : _blocks(0), _length(0)
+{
+    reset(capacity);
+}
+
+BlockChain::BlockChain(const BlockChain &other)
+    : _values(other._values), _starts(other._starts), _counts(other._counts),
+      _slots(other._slots), _blocks(other._blocks), _length(other._length) {}
+
+BlockChain &BlockChain::operator=(const BlockChain &other)
+{
+    if (this != &other)
+    {
+        _values = other._values;
+        _starts = other._starts;
+        _counts = other._counts;
+        _slots = other._slots;
+        _blocks = other._blocks;
+        _length = other._length;
+    }
+    return *this;
+}
+
+BlockChain::~BlockChain() {}
+
+// The chain is laid out with about capacity / 2 values, half a block each,
+// and every split needs at least half a block of insertions before it
+size_t BlockChain::blocksFor(size_t capacity)
+{
+    return 2 * (capacity / (BLOCK_CAPACITY / 2)) + 3;
+}
+
+// Storage only grows, so the arena's one BlockChain serves every level
+void BlockChain::reset(size_t capacity)
+{
+    size_t blocks = blocksFor(capacity);
+    if (_starts.size() < blocks)
+    {
+        _values.resize(blocks * BLOCK_CAPACITY);
+        _starts.resize(blocks);
+        _counts.resize(blocks);
+        _slots.resize(blocks);
+    }
+    _blocks = 1;
+    _length = 0;
+    _starts[0] = 0;
+    _counts[0] = 0;
+    _slots[0] = 0;
+}
+
+void BlockChain::append(size_t id, size_t index)
+{
+    size_t last = _blocks - 1;
+    if (_counts[last] == BLOCK_CAPACITY / 2)
+    {
+        last = _blocks++;
+        _starts[last] = _length;
+        _counts[last] = 0;
+        _slots[last] = last;
+    }
+    _values[_slots[last] * BLOCK_CAPACITY + _counts[last]++] = Value(id, index);
+    _length++;
+}
+
+size_t BlockChain::insert(size_t position, size_t id, size_t index)
+{
+    size_t block = blockOf(position);
+    size_t moved = 0;
+    if (_counts[block] == BLOCK_CAPACITY)
+    {
+        split(block);
+        moved += BLOCK_CAPACITY / 2;
+        if (position >= _starts[block + 1])
+            block++;
+    }
+
+    Value *values = &_values[_slots[block] * BLOCK_CAPACITY];
+    size_t offset = position - _starts[block];
+    std::memmove(values + offset + 1, values + offset,
+                 (_counts[block] - offset) * sizeof(*values));
+    values[offset] = Value(id, index);
+    moved += _counts[block] - offset + 1;
+    _counts[block]++;
+    for (size_t i = block + 1; i < _blocks; ++i)
+        _starts[i]++;
+    _length++;
+    return moved;
+}
+
+// The upper half goes to a fresh storage slot, listed right after `block`;
+// slots are handed out in order and never freed, so the next one is _blocks
+void BlockChain::split(size_t block)
+{
+    size_t half = BLOCK_CAPACITY / 2;
+    size_t slot = _blocks;
+    std::memcpy(&_values[slot * BLOCK_CAPACITY],
+                &_values[_slots[block] * BLOCK_CAPACITY + half],
+                half * sizeof(_values[0]));
+    std::copy_backward(&_starts[block + 1], &_starts[_blocks], &_starts[_blocks + 1]);
+    std::copy_backward(&_counts[block + 1], &_counts[_blocks], &_counts[_blocks + 1]);
+    std::copy_backward(&_slots[block + 1], &_slots[_blocks], &_slots[_blocks + 1]);
+    _starts[block + 1] = _starts[block] + half;
+    _counts[block + 1] = BLOCK_CAPACITY - half;
+    _slots[block + 1] = slot;
+    _counts[block] = half;
+    _blocks++;
+}
+
+void BlockChain::copyTo(size_t *out) const
+{
+    for (size_t block = 0; block < _blocks; ++block)
+    {
+        const Value *values = &_values[_slots[block] * BLOCK_CAPACITY];
+        for (size_t i = 0; i < _counts[block]; ++i)
+            *out++ = values[i].second;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef BLOCKCHAIN_HPP
+#define BLOCKCHAIN_HPP
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+// Values a BlockChain block holds; a full block is split in two
+#define BLOCK_CAPACITY 2048
+
+// The chain of the exact insertion on large levels (see insertPendSerial):
+// elements as (id, level index) pairs in blocks of up to BLOCK_CAPACITY,
+// listed in chain order with the position of their first element. A
+// position is found with a binary search of those starts, and an insertion
+// moves the rest of one block and bumps the starts after it; a full block
+// is split first. Blocks are filled half way to begin with, so with n
+// elements an insertion is O(BLOCK_CAPACITY + n / BLOCK_CAPACITY) however
+// the keys fall. The id is kept with the index so that a probe reaches the
+// element with one memory access less.
+class BlockChain
+{
+public:
+    BlockChain();
+    // Room for chains of up to `capacity` values
+    explicit BlockChain(size_t capacity);
+    BlockChain(const BlockChain &other);
+    BlockChain &operator=(const BlockChain &other);
+    ~BlockChain();
+
+    // Starts over with an empty chain that grows to at most `capacity`
+    void reset(size_t capacity);
+    // Adds an element at the end while the chain is first laid out
+    void append(size_t id, size_t index);
+    // Inserts in front of `position` (the length appends); returns the
+    // values written
+    size_t insert(size_t position, size_t id, size_t index);
+    // Writes the level indices to `out` in chain order
+    void copyTo(size_t *out) const;
+
+    size_t idAt(size_t position) const
+    {
+        size_t block = blockOf(position);
+        return _values[_slots[block] * BLOCK_CAPACITY + position - _starts[block]].first;
+    }
+
+private:
+    typedef std::pair<size_t, size_t> Value;
+
+    std::vector<Value> _values;         // BLOCK_CAPACITY per storage slot
+    std::vector<size_t> _starts;        // chain order -> position of first value
+    std::vector<size_t> _counts;        // chain order -> values held
+    std::vector<size_t> _slots;         // chain order -> storage slot
+    size_t _blocks;
+    size_t _length;
+
+    // Last block that starts at or before `position`. Halving the range
+    // without a branch on the outcome: the searches probe all over the
+    // chain, so that outcome could not be predicted anyway.
+    size_t blockOf(size_t position) const
+    {
+        const size_t *first = &_starts[0];
+        for (size_t count = _blocks; count > 1; )
+        {
+            size_t half = count / 2;
+            first = (first[half] <= position) ? first + half : first;
+            count -= half;
+        }
+        return first - &_starts[0];
+    }
+
+    void split(size_t block);
+    static size_t blocksFor(size_t capacity);
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include "ExternalSort.hpp"
+#include "PmergeMe.hpp"
+#include "LoserTree.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// One run being merged: a window of its values and how many are still on disk
+struct RunSource
+{
+    std::vector<int> buffer;
+    size_t pos;
+    size_t filled;
+    size_t left;
+};
+
+// Seconds on the monotonic clock
+static double now()
+{
+    return monotonicUs() / 1e6;
+}
+
+// Reads the next window of a run with as few read(2) calls as it takes
+static bool refill(RunSource &source, int fd)
+{
+    size_t count = source.buffer.size();
+    if (count > source.left)
+        count = source.left;
+    char *data = reinterpret_cast<char *>(count > 0 ? &source.buffer[0] : NULL);
+    size_t want = count * sizeof(int);
+    size_t got = 0;
+
+    while (got < want)
+    {
+        ssize_t n = read(fd, data + got, want - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+    source.pos = 0;
+    source.filled = count;
+    source.left -= count;
+    return true;
+}
+
+ExternalSort::ExternalSort(PmergeMe &sorter, size_t memoryBytes, size_t threads)
+    : _sorter(sorter), _memory(memoryBytes), _start(0), _values(0), _sortComparisons(0),
+      _mergeComparisons(0), _bytesSpilled(0), _passes(0)
+{
+    size_t perElement = (threads > 1) ? PARALLEL_BYTES_PER_ELEMENT : BYTES_PER_ELEMENT;
+    _runLength = _memory / perElement;
+    if (_runLength < 1024)
+        _runLength = 1024;
+}
+
+ExternalSort::~ExternalSort()
+{
+    closeRuns();
+}
+
+const std::string &ExternalSort::error() const
+{
+    return _error;
+}
+
+void ExternalSort::closeRuns()
+{
+    for (size_t i = 0; i < _runs.size(); ++i)
+    {
+        if (_runs[i].fd >= 0)
+            ::close(_runs[i].fd);
+    }
+    _runs.clear();
+}
+
+// Temporary files are unlinked right away: they vanish with their
+// descriptor, whatever way the program ends
+bool ExternalSort::openTemp(int &fd)
+{
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string((dir != NULL && *dir != '\0') ? dir : "/tmp")
+                       + "/pmerge-run-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+    fd = mkstemp(&name[0]);
+    if (fd < 0)
+    {
+        _error = "Error: could not create a temporary file in " + path.substr(0, path.rfind('/'))
+                 + ".";
+        return false;
+    }
+    unlink(&name[0]);
+    return true;
+}
+
+void ExternalSort::putValue(OutputBuffer &out, int value, Format format)
+{
+    if (format == FORMAT_TEXT)
+    {
+        out.putInt(value);
+        out.put('\n');
+    }
+    else if (format == FORMAT_RAW)
+        out.put(reinterpret_cast<const char *>(&value), sizeof(value));
+    else
+    {
+        unsigned int bits = static_cast<unsigned int>(value);
+        char bytes[4];
+        bytes[0] = static_cast<char>(bits & 0xff);
+        bytes[1] = static_cast<char>((bits >> 8) & 0xff);
+        bytes[2] = static_cast<char>((bits >> 16) & 0xff);
+        bytes[3] = static_cast<char>((bits >> 24) & 0xff);
+        out.put(bytes, sizeof(bytes));
+    }
+}
+
+void ExternalSort::report(const char *phase, size_t done, size_t total, double since) const
+{
+    double seconds = now() - since;
+    std::cerr << "external: " << phase << " " << std::fixed << std::setprecision(1)
+              << (total > 0 ? 100.0 * done / total : 100.0) << "%, "
+              << std::setprecision(2) << (seconds > 0 ? done / seconds / 1e6 : 0)
+              << " M values/s" << std::endl;
+}
+
+// Writes one sorted run to a new temporary file
+bool ExternalSort::spill(const std::vector<int> &values)
+{
+    Run run;
+    if (!openTemp(run.fd))
+        return false;
+    run.count = values.size();
+    _runs.push_back(run);
+
+    OutputBuffer out(run.fd);
+    for (size_t i = 0; i < values.size(); ++i)
+        putValue(out, values[i], FORMAT_RAW);
+    out.flush();
+    if (out.failed() || lseek(run.fd, 0, SEEK_SET) != 0)
+    {
+        _error = "Error: could not write a temporary run.";
+        return false;
+    }
+    _bytesSpilled += values.size() * sizeof(int);
+    return true;
+}
+
+// STEP 1: cut the input into runs of _runLength values and sort each one.
+// Input that fits in a single run goes straight to the output.
+bool ExternalSort::formRuns(InputReader &reader, bool binary, OutputBuffer &out,
+                            Format outFormat)
+{
+    std::vector<int> chunk;
+    chunk.reserve(_runLength);
+
+    while (!reader.done())
+    {
+        double runStart = now();
+        chunk.clear();
+        if (!(binary ? reader.parseBinary(chunk, _runLength)
+                     : reader.parseText(chunk, _runLength)))
+        {
+            _error = reader.error();
+            return false;
+        }
+        if (chunk.empty())
+            break;
+        _sorter.mergeInsertSort(chunk);
+        _sortComparisons += _sorter.lastStats().comparisons;
+        _values += chunk.size();
+
+        if (_runs.empty() && reader.done())
+        {
+            for (size_t i = 0; i < chunk.size(); ++i)
+                putValue(out, chunk[i], outFormat);
+            return true;
+        }
+        if (!spill(chunk))
+            return false;
+        std::cerr << "external: run " << _runs.size() << ": " << chunk.size()
+                  << " values sorted and spilled in " << std::fixed << std::setprecision(3)
+                  << now() - runStart << " s, " << std::setprecision(1)
+                  << 100.0 * reader.position() / reader.size() << "% of input read" << std::endl;
+    }
+    return true;
+}
+
+// STEP 2: k-way merge of _runs[first, first + count) into `out`, through a
+// loser tree over the heads of the runs. The memory budget is split evenly
+// between the runs' read buffers.
+bool ExternalSort::mergeGroup(size_t first, size_t count, OutputBuffer &out, Format format,
+                              const char *phase)
+{
+    size_t window = _memory / count / sizeof(int);
+    if (window < 1024)
+        window = 1024;
+
+    std::vector<RunSource> sources(count);
+    LoserTree<int> tree;
+    tree.reset(count);
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        RunSource &source = sources[i];
+        source.left = _runs[first + i].count;
+        source.buffer.resize(source.left < window ? source.left : window);
+        total += source.left;
+        if (!refill(source, _runs[first + i].fd))
+        {
+            _error = "Error: could not read a temporary run.";
+            return false;
+        }
+        if (source.filled > 0)
+            tree.set(i, source.buffer[source.pos++]);
+    }
+    tree.build();
+
+    double mergeStart = now();
+    size_t step = total / 20 + 1;
+    size_t done = 0;
+    while (!tree.empty())
+    {
+        size_t s = tree.winner();
+        putValue(out, tree.winnerKey(), format);
+        RunSource &source = sources[s];
+        if (source.pos == source.filled && source.left > 0
+            && !refill(source, _runs[first + s].fd))
+        {
+            _error = "Error: could not read a temporary run.";
+            return false;
+        }
+        if (source.pos < source.filled)
+            tree.replaceWinner(source.buffer[source.pos++]);
+        else
+            tree.exhaustWinner();
+        if (++done % step == 0)
+            report(phase, done, total, mergeStart);
+    }
+    _mergeComparisons += tree.comparisons();
+    return true;
+}
+
+bool ExternalSort::run(const std::string &inputPath, bool binary, const std::string &outputPath)
+{
+    _start = now();
+    if (inputPath == "-")
+    {
+        _error = "Error: external sort needs a regular input file, not stdin.";
+        return false;
+    }
+    InputReader reader;
+    if (!reader.open(inputPath))
+    {
+        _error = reader.error();
+        return false;
+    }
+
+    int outFd = STDOUT_FILENO;
+    std::string tempPath;
+    std::string replaced;
+    if (outputPath != "-")
+    {
+        // The output is written next to its target and renamed over it
+        // (through any symlink) once everything is in: a sort that fails
+        // part way, on a bad value or a full disk, leaves the old file as
+        // it was, and a file sorted onto itself is not truncated under its
+        // own mapping. A device or a pipe is written to directly.
+        struct stat outInfo;
+        bool exists = stat(outputPath.c_str(), &outInfo) == 0;
+        if (exists && !S_ISREG(outInfo.st_mode))
+            outFd = ::open(outputPath.c_str(), O_WRONLY | O_TRUNC);
+        else
+        {
+            char resolved[PATH_MAX];
+            replaced = (exists && realpath(outputPath.c_str(), resolved) != NULL) ? resolved
+                                                                                  : outputPath;
+            // mkstemp creates the file 0600; give it what open would have
+            mode_t mask = umask(0);
+            umask(mask);
+            mode_t mode = exists ? (outInfo.st_mode & 07777) : (0644 & ~mask);
+            std::string pattern = replaced + ".XXXXXX";
+            std::vector<char> name(pattern.begin(), pattern.end());
+            name.push_back('\0');
+            outFd = mkstemp(&name[0]);
+            if (outFd >= 0)
+            {
+                tempPath = &name[0];
+                fchmod(outFd, mode);
+            }
+        }
+        if (outFd < 0)
+        {
+            _error = "Error: could not open " + outputPath + ".";
+            return false;
+        }
+    }
+    std::cout.flush();
+    Format outFormat = binary ? FORMAT_BINARY : FORMAT_TEXT;
+    OutputBuffer out(outFd);
+
+    bool ok = formRuns(reader, binary, out, outFormat);
+
+    // Intermediate passes while the runs outnumber the buffers the budget holds
+    size_t fanIn = _memory / MIN_MERGE_BUFFER;
+    if (fanIn < 2)
+        fanIn = 2;
+    while (ok && _runs.size() > fanIn)
+    {
+        std::vector<Run> merged;
+        _passes++;
+        for (size_t first = 0; ok && first < _runs.size(); first += fanIn)
+        {
+            size_t count = (_runs.size() - first < fanIn) ? _runs.size() - first : fanIn;
+            Run run;
+            run.count = 0;
+            ok = openTemp(run.fd);
+            if (!ok)
+                break;
+            merged.push_back(run);
+            for (size_t i = first; i < first + count; ++i)
+                merged.back().count += _runs[i].count;
+
+            OutputBuffer spillOut(run.fd);
+            ok = mergeGroup(first, count, spillOut, FORMAT_RAW, "intermediate merge");
+            spillOut.flush();
+            if (ok && (spillOut.failed() || lseek(run.fd, 0, SEEK_SET) != 0))
+            {
+                _error = "Error: could not write a temporary run.";
+                ok = false;
+            }
+            _bytesSpilled += merged.back().count * sizeof(int);
+            for (size_t i = first; i < first + count; ++i)
+            {
+                ::close(_runs[i].fd);
+                _runs[i].fd = -1;
+            }
+        }
+        closeRuns();
+        _runs.swap(merged);
+    }
+    if (ok && !_runs.empty())
+    {
+        _passes++;
+        ok = mergeGroup(0, _runs.size(), out, outFormat, "merge");
+    }
+    closeRuns();
+
+    out.flush();
+    if (ok && out.failed())
+    {
+        _error = "Error: could not write " + outputPath + ".";
+        ok = false;
+    }
+    if (outFd != STDOUT_FILENO)
+        ::close(outFd);
+    if (!tempPath.empty())
+    {
+        if (ok && std::rename(tempPath.c_str(), replaced.c_str()) != 0)
+        {
+            _error = "Error: could not replace " + outputPath + ".";
+            ok = false;
+        }
+        if (!ok)
+            unlink(tempPath.c_str());
+    }
+    if (!ok)
+        return false;
+
+    double seconds = now() - _start;
+    std::cerr << "external: " << _values << " values in " << std::fixed << std::setprecision(3)
+              << seconds << " s (" << std::setprecision(1)
+              << (seconds > 0 ? reader.size() / seconds / 1e6 : 0) << " MB/s of input), "
+              << "run length " << _runLength << ", merge passes " << _passes << ", "
+              << _bytesSpilled / (1 << 20) << " MiB spilled" << std::endl;
+    std::cerr << "external: comparisons " << _sortComparisons << " sorting runs + "
+              << _mergeComparisons << " merging" << std::endl;
+    return true;
+}
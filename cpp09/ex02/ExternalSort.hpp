@@ -0,0 +1,77 @@
+#ifndef EXTERNALSORT_HPP
+#define EXTERNALSORT_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "InputReader.hpp"
+#include "OutputBuffer.hpp"
+
+class PmergeMe;
+
+// Out-of-core sort for inputs larger than memory. The input is cut into
+// runs that fit the memory budget, each sorted with mergeInsertSort and
+// spilled to an unlinked temporary file; the runs are then k-way merged
+// through a loser tree with large sequential reads. When there are more
+// runs than buffers fit in the budget, intermediate passes merge them into
+// fewer, longer runs first. Progress and throughput go to stderr.
+class ExternalSort
+{
+private:
+    ExternalSort(const ExternalSort &other);
+    ExternalSort &operator=(const ExternalSort &other);
+
+public:
+    // Bytes of working memory one element of a run costs in mergeInsertSort
+    // (value, arena slices, chain node; parallel buffers on top)
+    static const size_t BYTES_PER_ELEMENT = 128;
+    static const size_t PARALLEL_BYTES_PER_ELEMENT = 192;
+    // Smallest read buffer worth giving a run during a merge
+    static const size_t MIN_MERGE_BUFFER = 1 << 20;
+
+    ExternalSort(PmergeMe &sorter, size_t memoryBytes, size_t threads);
+    ~ExternalSort();
+
+    // Sorts `inputPath` (text or little-endian int32) into `outputPath` in
+    // the same format, text as one value per line; "-" is stdout
+    bool run(const std::string &inputPath, bool binary, const std::string &outputPath);
+    const std::string &error() const;
+
+private:
+    struct Run
+    {
+        int fd;
+        size_t count;
+    };
+
+    enum Format
+    {
+        FORMAT_RAW,     // host int32, temporary runs only
+        FORMAT_BINARY,  // little-endian int32
+        FORMAT_TEXT     // decimal, one value per line
+    };
+
+    PmergeMe &_sorter;
+    size_t _memory;
+    size_t _runLength;
+    std::vector<Run> _runs;
+    std::string _error;
+    double _start;
+    size_t _values;
+    size_t _sortComparisons;
+    size_t _mergeComparisons;
+    size_t _bytesSpilled;
+    size_t _passes;
+
+    bool formRuns(InputReader &reader, bool binary, OutputBuffer &out, Format outFormat);
+    bool spill(const std::vector<int> &values);
+    bool mergeGroup(size_t first, size_t count, OutputBuffer &out, Format format,
+                    const char *phase);
+    bool openTemp(int &fd);
+    void closeRuns();
+    void report(const char *phase, size_t done, size_t total, double since) const;
+    static void putValue(OutputBuffer &out, int value, Format format);
+};
+
+#endif
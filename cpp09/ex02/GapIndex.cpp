@@ -0,0 +1,89 @@
+#include "GapIndex.hpp"
+
+#include <algorithm>
+
+GapIndex::GapIndex() : _gaps(0), _top(0) {}
+
+GapIndex::GapIndex(size_t capacity) : _counts(capacity + 1), _gaps(0), _top(0)
+{
+    size_t padded = 1;
+    while (padded < capacity + 1)
+        padded *= 2;
+    _tree.resize(padded + 1);
+}
+
+GapIndex::GapIndex(const GapIndex &other)
+    : _tree(other._tree), _counts(other._counts), _gaps(other._gaps), _top(other._top) {}
+
+GapIndex &GapIndex::operator=(const GapIndex &other)
+{
+    if (this != &other)
+    {
+        _tree = other._tree;
+        _counts = other._counts;
+        _gaps = other._gaps;
+        _top = other._top;
+    }
+    return *this;
+}
+
+GapIndex::~GapIndex() {}
+
+// Every gap but the last holds just its chain element. The tree is padded
+// with empty gaps to a power of two, so find() never needs a range check,
+// and built bottom-up in one pass rather than with `length` additions.
+void GapIndex::reset(size_t length)
+{
+    _gaps = length + 1;
+    _top = 1;
+    while (_top < _gaps)
+        _top *= 2;
+    if (_tree.size() < _top + 1)
+        _tree.resize(_top + 1);
+    if (_counts.size() < _gaps)
+        _counts.resize(_gaps);
+
+    size_t *tree = &_tree[0];
+    for (size_t i = 1; i <= _top; ++i)
+        tree[i] = (i <= length) ? 1 : 0;
+    for (size_t i = 1; i < _top; ++i)
+        tree[i + (i & (~i + 1))] += tree[i];
+    std::fill(_counts.begin(), _counts.begin() + _gaps, 0);
+}
+
+void GapIndex::add(size_t gap)
+{
+    _counts[gap]++;
+    size_t *tree = &_tree[0];
+    for (size_t i = gap + 1; i <= _top; i += i & (~i + 1))
+        tree[i]++;
+}
+
+size_t GapIndex::end(size_t gap) const
+{
+    // Everything in gaps [0, gap), then the gap itself
+    const size_t *tree = &_tree[0];
+    size_t position = _counts[gap];
+    for (size_t i = gap; i > 0; i -= i & (~i + 1))
+        position += tree[i];
+    return position;
+}
+
+// Counts the leading gaps that all end at or before `position`, halving the
+// step every time
+size_t GapIndex::find(size_t position, size_t &offset) const
+{
+    const size_t *tree = &_tree[0];
+    size_t gap = 0;
+    for (size_t step = _top; step > 0; step /= 2)
+    {
+        size_t size = tree[gap + step];
+        if (size <= position)
+        {
+            gap += step;
+            position -= size;
+        }
+    }
+    offset = position;
+    return gap;
+}
@@ -0,0 +1,43 @@
+#ifndef GAPINDEX_HPP
+#define GAPINDEX_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Positions in a chain of `length` elements that further elements are being
+// slotted in between. Gap g is the space in front of chain element g (gap
+// length is the end). The whole sequence reads: the elements in gap 0,
+// chain[0], the elements in gap 1, chain[1], ..., the elements in gap
+// length. A Fenwick tree over the gap sizes (each counting its chain
+// element) turns a position of that sequence into a gap and back in
+// O(log length).
+class GapIndex
+{
+public:
+    GapIndex();
+    // Room for chains of up to `capacity` elements
+    explicit GapIndex(size_t capacity);
+    GapIndex(const GapIndex &other);
+    GapIndex &operator=(const GapIndex &other);
+    ~GapIndex();
+
+    // Starts over with a chain of `length` elements and empty gaps
+    void reset(size_t length);
+    // One more element in gap `gap`
+    void add(size_t gap);
+    // Position of chain element `gap`, or the length of the whole sequence
+    // for gap length
+    size_t end(size_t gap) const;
+    // Gap that holds position `position` (< the length of the whole
+    // sequence); `offset` is the position within the gap, the gap size for
+    // the chain element itself
+    size_t find(size_t position, size_t &offset) const;
+
+private:
+    std::vector<size_t> _tree;      // 1-based, entry g + 1 covers gap g
+    std::vector<size_t> _counts;
+    size_t _gaps;                   // length + 1
+    size_t _top;                    // _gaps rounded up to a power of two
+};
+
+#endif
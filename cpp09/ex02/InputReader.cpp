@@ -0,0 +1,229 @@
+#include "InputReader.hpp"
+
+#include <climits>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+InputReader::InputReader()
+    : _map(NULL), _mapSize(0), _data(NULL), _size(0), _pos(0), _released(0) {}
+
+InputReader::~InputReader()
+{
+    close();
+}
+
+void InputReader::close()
+{
+    if (_map != NULL)
+        munmap(_map, _mapSize);
+    _map = NULL;
+    _mapSize = 0;
+    _buffer.clear();
+    _data = NULL;
+    _size = 0;
+    _pos = 0;
+    _released = 0;
+}
+
+const std::string &InputReader::error() const
+{
+    return _error;
+}
+
+bool InputReader::done() const
+{
+    return _pos >= _size;
+}
+
+// Input bytes in total and consumed so far
+size_t InputReader::size() const
+{
+    return _size;
+}
+
+size_t InputReader::position() const
+{
+    return _pos;
+}
+
+// Drops the mapped pages in front of the parse position; they are clean
+// file pages, so the kernel just forgets them
+void InputReader::release()
+{
+    if (_map == NULL)
+        return;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t upTo = _pos / page * page;
+    if (upTo > _released)
+    {
+        madvise(static_cast<char *>(_map) + _released, upTo - _released, MADV_DONTNEED);
+        _released = upTo;
+    }
+}
+
+bool InputReader::open(const std::string &path)
+{
+    close();
+    if (path == "-")
+        return readStream(STDIN_FILENO);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        _error = "Error: could not open " + path + ".";
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, info.st_size, MADV_SEQUENTIAL);
+            _map = map;
+            _mapSize = info.st_size;
+            _data = static_cast<const char *>(map);
+            _size = _mapSize;
+            ::close(fd);
+            return true;
+        }
+    }
+
+    bool ok = readStream(fd);
+    ::close(fd);
+    return ok;
+}
+
+// Pipes and terminals cannot be mapped: read them whole, 1 MiB at a time
+bool InputReader::readStream(int fd)
+{
+    const size_t chunk = 1 << 20;
+    size_t used = 0;
+
+    while (true)
+    {
+        if (_buffer.size() < used + chunk)
+            _buffer.resize(used + chunk);
+        ssize_t got = read(fd, &_buffer[used], chunk);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            _error = "Error: could not read input.";
+            return false;
+        }
+        if (got == 0)
+            break;
+        used += got;
+    }
+    _data = _buffer.empty() ? NULL : &_buffer[0];
+    _size = used;
+    return true;
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool InputReader::parseText(std::vector<int> &out)
+{
+    const char *p = _data + _pos;
+    const char *end = _data + _size;
+
+    // Count the tokens first so the output is allocated exactly once
+    size_t count = 0;
+    bool inToken = false;
+    for (const char *c = p; c < end; ++c)
+    {
+        bool space = isSpace(*c);
+        if (!space && !inToken)
+            ++count;
+        inToken = !space;
+    }
+    out.reserve(out.size() + count);
+    return parseText(out, count);
+}
+
+bool InputReader::parseText(std::vector<int> &out, size_t maxCount)
+{
+    const char *p = _data + _pos;
+    const char *end = _data + _size;
+
+    for (size_t parsed = 0; parsed < maxCount; ++parsed)
+    {
+        while (p < end && isSpace(*p))
+            ++p;
+        if (p == end)
+            break;
+
+        long value = 0;
+        while (p < end && !isSpace(*p))
+        {
+            if (*p < '0' || *p > '9')
+            {
+                _error = "Error: Invalid character in input.";
+                return false;
+            }
+            value = value * 10 + (*p - '0');
+            if (value > INT_MAX)
+            {
+                _error = "Error: Number out of range.";
+                return false;
+            }
+            ++p;
+        }
+        out.push_back(static_cast<int>(value));
+    }
+
+    // Only whitespace left counts as the end of the input
+    while (p < end && isSpace(*p))
+        ++p;
+    _pos = p - _data;
+    release();
+    return true;
+}
+
+bool InputReader::parseBinary(std::vector<int> &out)
+{
+    return parseBinary(out, (_size - _pos) / 4);
+}
+
+bool InputReader::parseBinary(std::vector<int> &out, size_t maxCount)
+{
+    if (_size % 4 != 0)
+    {
+        _error = "Error: Binary input size is not a multiple of 4 bytes.";
+        return false;
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(_data + _pos);
+    size_t count = (_size - _pos) / 4;
+    if (count > maxCount)
+        count = maxCount;
+    size_t base = out.size();
+    out.resize(base + count);
+
+    for (size_t i = 0; i < count; ++i, p += 4)
+    {
+        // Decoded byte by byte, so the format does not depend on the host
+        unsigned int bits = static_cast<unsigned int>(p[0])
+                          | (static_cast<unsigned int>(p[1]) << 8)
+                          | (static_cast<unsigned int>(p[2]) << 16)
+                          | (static_cast<unsigned int>(p[3]) << 24);
+        if (bits > static_cast<unsigned int>(INT_MAX))
+        {
+            out.resize(base);
+            _error = "Error: Negative numbers are not allowed.";
+            return false;
+        }
+        out[base + i] = static_cast<int>(bits);
+    }
+    _pos += count * 4;
+    release();
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef INPUTREADER_HPP
+#define INPUTREADER_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Bulk integer input for PmergeMe. Regular files are mmap'ed read-only
+// (MADV_SEQUENTIAL); stdin ("-") and pipes are read in large chunks into one
+// buffer. The whole-input parsers count the values first and reserve the
+// output once; the chunked ones serve inputs larger than memory.
+class InputReader
+{
+private:
+    InputReader(const InputReader &other);
+    InputReader &operator=(const InputReader &other);
+
+public:
+    InputReader();
+    ~InputReader();
+
+    bool open(const std::string &path);
+
+    // Whitespace separated non-negative decimal integers
+    bool parseText(std::vector<int> &out);
+    // Little-endian int32 values, no header
+    bool parseBinary(std::vector<int> &out);
+
+    // Chunked variants: append at most maxCount values, continuing where the
+    // previous call stopped. Mapped pages already parsed are handed back to
+    // the kernel, so a mapping larger than memory can be streamed.
+    bool parseText(std::vector<int> &out, size_t maxCount);
+    bool parseBinary(std::vector<int> &out, size_t maxCount);
+    bool done() const;
+    size_t size() const;
+    size_t position() const;
+
+    const std::string &error() const;
+
+private:
+    void *_map;
+    size_t _mapSize;
+    std::vector<char> _buffer;
+    const char *_data;
+    size_t _size;
+    size_t _pos;
+    size_t _released;
+    std::string _error;
+
+    bool readStream(int fd);
+    void release();
+    void close();
+};
+
+#endif
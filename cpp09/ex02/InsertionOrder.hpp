@@ -0,0 +1,96 @@
+#ifndef INSERTIONORDER_HPP
+#define INSERTIONORDER_HPP
+
+#include <cstddef>
+
+#define JACOBSTHAL_SIZE 64
+
+// Jacobsthal numbers J(k) = J(k - 1) + 2 J(k - 2), J(0) = 0, J(1) = 1.
+// J(63) is the last one below 2^64, so the table covers any size_t on a
+// platform where size_t (and unsigned long, for the literals) is 64 bits,
+// which is all this table assumes; anything narrower stops the build here.
+typedef char JacobsthalTableAssumes64BitSizeT[(sizeof(size_t) >= 8
+                                               && sizeof(unsigned long) >= 8) ? 1 : -1];
+static const size_t JACOBSTHAL[JACOBSTHAL_SIZE] = {
+    0UL, 1UL, 1UL, 3UL,
+    5UL, 11UL, 21UL, 43UL,
+    85UL, 171UL, 341UL, 683UL,
+    1365UL, 2731UL, 5461UL, 10923UL,
+    21845UL, 43691UL, 87381UL, 174763UL,
+    349525UL, 699051UL, 1398101UL, 2796203UL,
+    5592405UL, 11184811UL, 22369621UL, 44739243UL,
+    89478485UL, 178956971UL, 357913941UL, 715827883UL,
+    1431655765UL, 2863311531UL, 5726623061UL, 11453246123UL,
+    22906492245UL, 45812984491UL, 91625968981UL, 183251937963UL,
+    366503875925UL, 733007751851UL, 1466015503701UL, 2932031007403UL,
+    5864062014805UL, 11728124029611UL, 23456248059221UL, 46912496118443UL,
+    93824992236885UL, 187649984473771UL, 375299968947541UL, 750599937895083UL,
+    1501199875790165UL, 3002399751580331UL, 6004799503160661UL, 12009599006321323UL,
+    24019198012642645UL, 48038396025285291UL, 96076792050570581UL, 192153584101141163UL,
+    384307168202282325UL, 768614336404564651UL, 1537228672809129301UL, 3074457345618258603UL
+};
+
+// The order in which pend elements b2..b(pendSize + 1) are inserted, as
+// 0-based indices counted from b2 (b1 is placed for free), produced one at a
+// time. Group k covers the indices [J(k - 1) - 1, J(k) - 1) for k = 3, 4, ...
+// (b up to 3, 5, 11, 21, ...), clamped to pendSize, and is walked from its
+// highest index down, so every element of group k is searched in at most
+// 2^(k - 1) - 1 positions.
+class InsertionOrder
+{
+public:
+    explicit InsertionOrder(size_t pendSize)
+        : _pendSize(pendSize), _group(2), _begin(0), _end(0), _next(0)
+    {
+        nextGroup();
+    }
+
+    bool done() const
+    {
+        return _begin >= _pendSize;
+    }
+
+    // Current index; valid while !done()
+    size_t operator*() const
+    {
+        return _next - 1;
+    }
+
+    InsertionOrder &operator++()
+    {
+        if (--_next == _begin)
+            nextGroup();
+        return *this;
+    }
+
+    // The current group is [groupBegin(), groupEnd()); callers that place a
+    // whole group at once step with nextGroup() instead of ++
+    size_t groupBegin() const
+    {
+        return _begin;
+    }
+
+    size_t groupEnd() const
+    {
+        return _end;
+    }
+
+    void nextGroup()
+    {
+        _group++;
+        _begin = _end;
+        _end = (_group < JACOBSTHAL_SIZE) ? JACOBSTHAL[_group] - 1 : _pendSize;
+        if (_end > _pendSize)
+            _end = _pendSize;
+        _next = _end;
+    }
+
+private:
+    size_t _pendSize;
+    size_t _group;
+    size_t _begin;
+    size_t _end;
+    size_t _next;
+};
+
+#endif
\ No newline at end of file
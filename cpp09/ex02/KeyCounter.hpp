@@ -0,0 +1,160 @@
+#ifndef KEYCOUNTER_HPP
+#define KEYCOUNTER_HPP
+
+#include <vector>
+#include <cstddef>
+
+// The hash table is grown once it is more than this full (in percent)
+#define KEYCOUNTER_MAX_LOAD 50
+
+// Key types KeyCounter can hash: the built-in integers. Only these are
+// defined, so any other key fails to compile with an incomplete
+// IntegerKey<T> instead of an error deep inside the hashing.
+template <typename T>
+struct IntegerKey;
+
+#define INTEGER_KEY(T)                                                      \
+    template <> struct IntegerKey<T>                                        \
+    {                                                                       \
+        static const bool value = true;                                     \
+    };
+
+INTEGER_KEY(char)
+INTEGER_KEY(signed char)
+INTEGER_KEY(unsigned char)
+INTEGER_KEY(short)
+INTEGER_KEY(unsigned short)
+INTEGER_KEY(int)
+INTEGER_KEY(unsigned int)
+INTEGER_KEY(long)
+INTEGER_KEY(unsigned long)
+
+#undef INTEGER_KEY
+
+// Counts the occurrences of each distinct key of an integral type. Distinct
+// keys are kept densely in first-seen order, with their counts alongside;
+// an open-addressing table with linear probing maps a key to its position
+// there. Keys are spread by Fibonacci hashing (multiplying by 2^64 / phi
+// and keeping the top bits), which is fast and scatters runs of nearby
+// values well.
+template <typename T>
+class KeyCounter
+{
+public:
+    KeyCounter();
+    KeyCounter(const KeyCounter &other);
+    KeyCounter &operator=(const KeyCounter &other);
+    ~KeyCounter();
+
+    void add(const T &key);
+
+    // Distinct keys so far, in first-seen order
+    const std::vector<T> &keys() const;
+    size_t size() const;
+    // Occurrences of `key` (0 if it never was added)
+    size_t count(const T &key) const;
+    // Buffers (re)allocated for the table so far
+    size_t allocations() const;
+
+private:
+    typedef char KeysMustBeIntegers[IntegerKey<T>::value ? 1 : -1];
+
+    std::vector<T> _keys;
+    std::vector<size_t> _counts;
+    std::vector<size_t> _slots;     // position in _keys + 1; 0 marks a free slot
+    unsigned int _shift;            // 64 - log2(_slots.size())
+    size_t _allocations;
+
+    size_t slotOf(const T &key) const;
+    void grow();
+};
+
+template <typename T>
+KeyCounter<T>::KeyCounter() : _slots(16, 0), _shift(60), _allocations(1) {}
+
+template <typename T>
+KeyCounter<T>::KeyCounter(const KeyCounter &other)
+    : _keys(other._keys), _counts(other._counts), _slots(other._slots),
+      _shift(other._shift), _allocations(other._allocations) {}
+
+template <typename T>
+KeyCounter<T> &KeyCounter<T>::operator=(const KeyCounter &other)
+{
+    if (this != &other)
+    {
+        _keys = other._keys;
+        _counts = other._counts;
+        _slots = other._slots;
+        _shift = other._shift;
+        _allocations = other._allocations;
+    }
+    return *this;
+}
+
+template <typename T>
+KeyCounter<T>::~KeyCounter() {}
+
+// Slot holding `key`, or the free slot where it would go
+template <typename T>
+size_t KeyCounter<T>::slotOf(const T &key) const
+{
+    size_t mask = _slots.size() - 1;
+    size_t slot = static_cast<size_t>((static_cast<unsigned long>(key) * 11400714819323198485UL)
+                                      >> _shift);
+    while (_slots[slot] != 0 && !(_keys[_slots[slot] - 1] == key))
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+template <typename T>
+void KeyCounter<T>::grow()
+{
+    _slots.assign(2 * _slots.size(), 0);
+    _shift--;
+    _allocations++;
+    for (size_t i = 0; i < _keys.size(); ++i)
+        _slots[slotOf(_keys[i])] = i + 1;
+}
+
+template <typename T>
+void KeyCounter<T>::add(const T &key)
+{
+    size_t slot = slotOf(key);
+    if (_slots[slot] != 0)
+    {
+        _counts[_slots[slot] - 1]++;
+        return;
+    }
+    _keys.push_back(key);
+    _counts.push_back(1);
+    _slots[slot] = _keys.size();
+    if (_keys.size() * 100 > _slots.size() * KEYCOUNTER_MAX_LOAD)
+        grow();
+}
+
+template <typename T>
+const std::vector<T> &KeyCounter<T>::keys() const
+{
+    return _keys;
+}
+
+template <typename T>
+size_t KeyCounter<T>::size() const
+{
+    return _keys.size();
+}
+
+template <typename T>
+size_t KeyCounter<T>::count(const T &key) const
+{
+    size_t slot = slotOf(key);
+    return (_slots[slot] != 0) ? _counts[_slots[slot] - 1] : 0;
+}
+
+template <typename T>
+size_t KeyCounter<T>::allocations() const
+{
+    return _allocations;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef LOSERTREE_HPP
+#define LOSERTREE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// Tournament tree of losers for a k-way merge. Leaf i is the current head
+// of source i; every internal node keeps the source that lost the match
+// played there, and node 0 the overall winner. Replacing the winner's key
+// replays a single leaf-to-root path against the stored losers, so each
+// output element costs ceil(log2 k) comparisons. Exhausted sources lose
+// to everything; ties go to the lower source index, so the merge is stable.
+template <typename T>
+class LoserTree
+{
+public:
+    LoserTree();
+    LoserTree(const LoserTree &other);
+    LoserTree &operator=(const LoserTree &other);
+    ~LoserTree();
+
+    // Starts a tournament over `sources` heads; set() each live one, then build()
+    void reset(size_t sources);
+    void set(size_t source, const T &key);
+    void build();
+
+    bool empty() const;
+    size_t winner() const;
+    const T &winnerKey() const;
+
+    // The winner's source produced its next key, or ran dry
+    void replaceWinner(const T &key);
+    void exhaustWinner();
+
+    size_t comparisons() const;
+
+private:
+    std::vector<T> _keys;
+    std::vector<char> _live;
+    std::vector<size_t> _losers;
+    size_t _comparisons;
+
+    bool beats(size_t a, size_t b);
+    void replay(size_t source);
+};
+
+template <typename T>
+LoserTree<T>::LoserTree() : _comparisons(0) {}
+
+template <typename T>
+LoserTree<T>::LoserTree(const LoserTree &other)
+    : _keys(other._keys), _live(other._live), _losers(other._losers),
+      _comparisons(other._comparisons) {}
+
+template <typename T>
+LoserTree<T> &LoserTree<T>::operator=(const LoserTree &other)
+{
+    if (this != &other)
+    {
+        _keys = other._keys;
+        _live = other._live;
+        _losers = other._losers;
+        _comparisons = other._comparisons;
+    }
+    return *this;
+}
+
+template <typename T>
+LoserTree<T>::~LoserTree() {}
+
+template <typename T>
+void LoserTree<T>::reset(size_t sources)
+{
+    _keys.assign(sources, T());
+    _live.assign(sources, 0);
+    _losers.assign(sources, 0);
+}
+
+template <typename T>
+void LoserTree<T>::set(size_t source, const T &key)
+{
+    _keys[source] = key;
+    _live[source] = 1;
+}
+
+template <typename T>
+bool LoserTree<T>::beats(size_t a, size_t b)
+{
+    if (_live[a] != _live[b])
+        return _live[a];
+    if (!_live[a])
+        return a < b;
+    _comparisons++;
+    if (_keys[a] < _keys[b])
+        return true;
+    if (_keys[b] < _keys[a])
+        return false;
+    return a < b;
+}
+
+template <typename T>
+void LoserTree<T>::build()
+{
+    size_t k = _keys.size();
+    if (k == 0)
+        return;
+
+    // Leaves sit at k..2k-1 of an implicit tree, the parent of node i is i / 2
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; ++i)
+        winners[k + i] = i;
+    for (size_t node = k - 1; node >= 1; --node)
+    {
+        size_t a = winners[2 * node];
+        size_t b = winners[2 * node + 1];
+        if (beats(a, b))
+        {
+            winners[node] = a;
+            _losers[node] = b;
+        }
+        else
+        {
+            winners[node] = b;
+            _losers[node] = a;
+        }
+    }
+    _losers[0] = (k == 1) ? 0 : winners[1];
+}
+
+template <typename T>
+bool LoserTree<T>::empty() const
+{
+    return _keys.empty() || !_live[_losers[0]];
+}
+
+template <typename T>
+size_t LoserTree<T>::winner() const
+{
+    return _losers[0];
+}
+
+template <typename T>
+const T &LoserTree<T>::winnerKey() const
+{
+    return _keys[_losers[0]];
+}
+
+template <typename T>
+void LoserTree<T>::replaceWinner(const T &key)
+{
+    size_t source = _losers[0];
+    _keys[source] = key;
+    replay(source);
+}
+
+template <typename T>
+void LoserTree<T>::exhaustWinner()
+{
+    size_t source = _losers[0];
+    _live[source] = 0;
+    replay(source);
+}
+
+template <typename T>
+void LoserTree<T>::replay(size_t source)
+{
+    size_t k = _keys.size();
+    for (size_t node = (source + k) / 2; node > 0; node /= 2)
+    {
+        if (beats(_losers[node], source))
+            std::swap(_losers[node], source);
+    }
+    _losers[0] = source;
+}
+
+template <typename T>
+size_t LoserTree<T>::comparisons() const
+{
+    return _comparisons;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "OutputBuffer.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+OutputBuffer::OutputBuffer(int fd) : _fd(fd), _used(0), _failed(false) {}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::flush()
+{
+    size_t done = 0;
+    while (done < _used)
+    {
+        ssize_t written = ::write(_fd, _buffer + done, _used - done);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            _failed = true;
+            break;
+        }
+        done += written;
+    }
+    _used = 0;
+}
+
+void OutputBuffer::write(const char *data, size_t length)
+{
+    if (_used + length > CAPACITY)
+        flush();
+    if (length > CAPACITY)
+    {
+        // Too large to buffer: hand it to the kernel directly
+        while (length > 0)
+        {
+            ssize_t written = ::write(_fd, data, length);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                _failed = true;
+                return;
+            }
+            data += written;
+            length -= written;
+        }
+        return;
+    }
+    std::memcpy(_buffer + _used, data, length);
+    _used += length;
+}
+
+void OutputBuffer::put(char c)
+{
+    if (_used == CAPACITY)
+        flush();
+    _buffer[_used++] = c;
+}
+
+void OutputBuffer::put(const char *str)
+{
+    write(str, std::strlen(str));
+}
+
+void OutputBuffer::put(const std::string &str)
+{
+    write(str.data(), str.size());
+}
+
+void OutputBuffer::put(const char *data, size_t length)
+{
+    write(data, length);
+}
+
+bool OutputBuffer::failed() const
+{
+    return _failed;
+}
+
+void OutputBuffer::putUnsigned(unsigned long value)
+{
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+
+    while (value >= 100)
+    {
+        unsigned long pair = (value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10)
+    {
+        *--p = DIGIT_PAIRS[value * 2 + 1];
+        *--p = DIGIT_PAIRS[value * 2];
+    }
+    else
+        *--p = static_cast<char>('0' + value);
+    write(p, end - p);
+}
+
+void OutputBuffer::putInt(long value)
+{
+    if (value < 0)
+    {
+        put('-');
+        // Negate in unsigned arithmetic so LONG_MIN does not overflow
+        putUnsigned(0UL - static_cast<unsigned long>(value));
+    }
+    else
+        putUnsigned(static_cast<unsigned long>(value));
+}
+
+void OutputBuffer::putHex(Unsigned64 value)
+{
+    static const char hex[] = "0123456789abcdef";
+    char digits[2 * sizeof(Unsigned64)];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+
+    do
+    {
+        *--p = hex[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    write(p, end - p);
+}
@@ -0,0 +1,45 @@
+#ifndef OUTPUTBUFFER_HPP
+#define OUTPUTBUFFER_HPP
+
+#include <string>
+#include <cstddef>
+
+// At least 64 bits on every data model; unsigned long is 32 on LLP64
+typedef unsigned long long Unsigned64;
+
+// Buffered writer straight to a file descriptor. Integers are formatted by
+// hand, two digits at a time, and the buffer goes out in 64 KiB write(2)
+// calls, bypassing iostream formatting and locale handling entirely.
+class OutputBuffer
+{
+private:
+    OutputBuffer(const OutputBuffer &other);
+    OutputBuffer &operator=(const OutputBuffer &other);
+
+public:
+    explicit OutputBuffer(int fd);
+    ~OutputBuffer();
+
+    void put(char c);
+    void put(const char *str);
+    void put(const std::string &str);
+    void put(const char *data, size_t length);
+    void putInt(long value);
+    void putUnsigned(unsigned long value);
+    void putHex(Unsigned64 value);
+    void flush();
+    // A write(2) failed (disk full, closed pipe); later output is dropped
+    bool failed() const;
+
+private:
+    static const size_t CAPACITY = 1 << 16;
+
+    int _fd;
+    size_t _used;
+    bool _failed;
+    char _buffer[CAPACITY];
+
+    void write(const char *data, size_t length);
+};
+
+#endif
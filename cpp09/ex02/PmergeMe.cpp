@@ -1,6 +1,8 @@
 #include "PmergeMe.hpp"
 
-PmergeMe::PmergeMe() {}
+PmergeMe::PmergeMe()
+    : _instrumented(false), _threads(1), _outputMode(OUTPUT_FULL), _endsCount(0), _trials(1),
+      _deduplicate(false) {}
 
 PmergeMe::PmergeMe(const PmergeMe &other)
 {
@@ -13,237 +15,306 @@ PmergeMe &PmergeMe::operator=(const PmergeMe &other)
     {
         _vec = other._vec;
         _deq = other._deq;
+        _stats = other._stats;
+        _instrumented = other._instrumented;
+        _threads = other._threads;
+        _outputMode = other._outputMode;
+        _endsCount = other._endsCount;
+        _trials = other._trials;
+        _deduplicate = other._deduplicate;
     }
     return *this;
 }
 
 PmergeMe::~PmergeMe() {}
 
-template <typename Container>
-void PmergeMe::binaryInsert(Container &mainChain, int value, size_t maxPos)
+// Runtime instrumentation: per-level counters and phase times (see printStats)
+void PmergeMe::setInstrumented(bool instrumented)
 {
-    if (mainChain.empty() || maxPos == 0)
-    {
-        mainChain.insert(mainChain.begin(), value);
-        return;
-    }
-    
-    // Limit search to the range [0, maxPos]
-    size_t left = 0;
-    size_t right = (maxPos < mainChain.size()) ? maxPos : mainChain.size();
-    
-    // Binary search for insertion position
-    while (left < right)
-    {
-        size_t mid = left + (right - left) / 2;
-        if (mainChain[mid] < value)
-            left = mid + 1;
-        else
-            right = mid;
-    }
-    
-    mainChain.insert(mainChain.begin() + left, value);
+    _instrumented = instrumented;
 }
 
-std::vector<size_t> PmergeMe::generateJacobsthalSequence(size_t maxSize)
+// Worker threads for the pairing and insertion phases (1 = serial, exact
+// Ford-Johnson comparison count)
+void PmergeMe::setThreads(size_t threads)
 {
-    std::vector<size_t> jacobsthal;
-    
-    if (maxSize == 0)
-        return jacobsthal;
-    
-    size_t j_prev2 = 0;  // J(0) = 0
-    size_t j_prev1 = 1;  // J(1) = 1
-    
-    jacobsthal.push_back(1);  // Start with J(1) = 1
-    
-    // Generate sequence until exceed maxSize
-    while (true)
-    {
-        size_t j_current = j_prev1 + 2 * j_prev2;  // Recurrence relation
-        if (j_current > maxSize)
-            break;
-        jacobsthal.push_back(j_current);
-        j_prev2 = j_prev1;
-        j_prev1 = j_current;
-    }
-    
-    return jacobsthal;
+    _threads = (threads == 0) ? 1 : threads;
+}
+
+// Sort only the distinct values and expand them (see mergeInsertSortDistinct)
+void PmergeMe::setDeduplicate(bool deduplicate)
+{
+    _deduplicate = deduplicate;
 }
 
-std::vector<size_t> PmergeMe::generateInsertionOrder(size_t pendSize)
+// Counters of the most recent mergeInsertSort call
+const SortStats &PmergeMe::lastStats() const
 {
-    std::vector<size_t> insertionOrder;
-    
-    if (pendSize == 0)
-        return insertionOrder;
-    
-    // Generate Jacobsthal sequence for this pend size
-    std::vector<size_t> jacobsthal = generateJacobsthalSequence(pendSize);
-    
-    // Build insertion order using Jacobsthal numbers as group boundaries
-    size_t prevJacob = 0;
-    
-    for (size_t i = 0; i < jacobsthal.size(); ++i)
+    return _stats;
+}
+
+// OUTPUT_ENDS prints the first and last `endsCount` elements
+void PmergeMe::setOutputMode(OutputMode mode, size_t endsCount)
+{
+    _outputMode = mode;
+    _endsCount = endsCount;
+}
+
+// Times every container over `trials` runs of copy-in and sort instead of one
+void PmergeMe::setTrials(size_t trials)
+{
+    _trials = (trials == 0) ? 1 : trials;
+}
+
+// Lays out a level's chain in arena.blockA: b1, which is no larger than the
+// smallest main chain element, then the main chain in order. mainRank maps
+// a larger element's level index to its main chain rank (-1 for the rest),
+// mainPos a main chain rank to its chain position. Returns the length.
+size_t PmergeMe::buildChain(const LevelPairs &pairs, const size_t *sortedPairs, size_t size,
+                            SortArena &arena)
+{
+    size_t pairCount = size / 2;
+    ChainItem *chain = &arena.blockA[0];
+    size_t *mainRank = &arena.mainRank[0];
+    size_t *mainPos = &arena.mainPos[0];
+
+    std::fill(mainRank, mainRank + size, static_cast<size_t>(-1));
+    size_t first = sortedPairs[0];
+    chain[0] = ChainItem(pairs.smaller[first], pairs.largerIndex[first] ^ 1);
+    for (size_t j = 0; j < pairCount; ++j)
     {
-        size_t currentJacob = jacobsthal[i];
-        if (currentJacob > pendSize)
-            currentJacob = pendSize;
-        
-        // Insert from currentJacob-1 down to prevJacob (reverse order within group)
-        // This creates the "pendulum" pattern
-        for (size_t j = currentJacob; j > prevJacob; --j)
-        {
-            insertionOrder.push_back(j - 1);  // Convert to 0-based index
-        }
-        
-        prevJacob = currentJacob;
-        if (currentJacob >= pendSize)
-            break;
+        size_t p = sortedPairs[j];
+        chain[j + 1] = ChainItem(arena.chains[pairs.largerOffset + p], pairs.largerIndex[p]);
+        mainRank[pairs.largerIndex[p]] = j;
+        mainPos[j] = j + 1;
     }
-    
-    // Add any remaining elements not covered by Jacobsthal sequence
-    for (size_t i = prevJacob; i < pendSize; ++i)
+    return pairCount + 1;
+}
+
+// Worst-case comparisons of Ford-Johnson for n elements:
+// F(n) = sum over k = 1..n of ceil(log2(3k / 4))
+size_t PmergeMe::fordJohnsonBound(size_t n)
+{
+    size_t total = 0;
+    for (size_t k = 1; k <= n; ++k)
     {
-        insertionOrder.push_back(i);
+        // smallest c with 2^c >= 3k / 4, i.e. 2^(c + 2) >= 3k
+        size_t c = 0;
+        while ((static_cast<size_t>(4) << c) < 3 * k)
+            ++c;
+        total += c;
     }
-    
-    return insertionOrder;
+    return total;
 }
 
-// comparator function for sorting pairs by their larger element (second)
-static bool pairSecondLess(const std::pair<int,int> &p1, const std::pair<int,int> &p2)
+template <typename Container>
+void PmergeMe::printSortedSequence(const Container &container)
 {
-    return p1.second < p2.second;
+    writeSequence("After:  ", container);
 }
 
+// Prints one labelled sequence line through an OutputBuffer on stdout,
+// honouring the output mode
 template <typename Container>
-void PmergeMe::mergeInsertSort(Container &container)
+void PmergeMe::writeSequence(const char *label, const Container &container)
 {
-    // Base case: arrays of size 0 or 1 are already sorted
-    if (container.size() <= 1)
-        return;
-    
-    // STEP 1: PAIRING PHASE
-    // Store pairs as (smaller, larger) to maintain the constraint
-    std::vector<std::pair<int, int> > pairs;
-    bool hasStraggler = false;
-    int straggler = 0;
-    
-    // Create pairs and sort each pair internally
-    for (size_t i = 0; i + 1 < container.size(); i += 2)
-    {
-        int a = container[i];
-        int b = container[i + 1];
-        if (a > b)
-            std::swap(a, b);
-        pairs.push_back(std::make_pair(a, b));  // (smaller, larger)
-    }
-    
-    // Handle odd element (straggler)
-    if (container.size() % 2 == 1)
-    {
-        hasStraggler = true;
-        straggler = container[container.size() - 1];
-    }
-    
-    // STEP 2: RECURSIVE SORT ON LARGER ELEMENTS
-    // Extract larger elements to form the main chain
-    Container mainChain;
-    // IMPORTANT: sort pairs by their larger element before extracting the main chain
-    // This preserves the correspondence between a larger element and its paired smaller
-    // element when we later insert the pend values.
-    // sort using file-scope comparator
-    std::sort(pairs.begin(), pairs.end(), pairSecondLess);
-
-    for (size_t i = 0; i < pairs.size(); ++i)
-    {
-        mainChain.push_back(pairs[i].second);  // larger element
-    }
-    
-    // Recursively sort the main chain
-    mergeInsertSort(mainChain);
-    
-    // STEP 3: BUILD PEND ARRAY
-    // Collect smaller elements (to be inserted)
-    std::vector<int> pend;
-    for (size_t i = 0; i < pairs.size(); ++i)
+    std::cout.flush();
+    OutputBuffer out(1);
+    size_t n = container.size();
+
+    out.put(label);
+    if (_outputMode == OUTPUT_CHECKSUM)
     {
-        pend.push_back(pairs[i].first);  // smaller element
+        // sum matches between Before and After when nothing was lost;
+        // FNV-1a depends on the order. It hashes the four bytes of each
+        // value low byte first, so every host prints the same hash.
+        unsigned long sum = 0;
+        Unsigned64 hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < n; ++i)
+        {
+            sum += static_cast<unsigned long>(container[i]);
+            unsigned int bits = static_cast<unsigned int>(container[i]);
+            for (size_t byte = 0; byte < 4; ++byte)
+                hash = (hash ^ ((bits >> (8 * byte)) & 0xff)) * 1099511628211ULL;
+        }
+        out.put("n=");
+        out.putUnsigned(n);
+        out.put(" sum=");
+        out.putUnsigned(sum);
+        out.put(" fnv1a=0x");
+        out.putHex(hash);
     }
-    
-    // STEP 4: INSERT FIRST PEND ELEMENT
-    // pend[0] is guaranteed ≤ mainChain[0], so insert at beginning (0 comparisons!)
-    if (!pend.empty())
+    else if (_outputMode == OUTPUT_ENDS && n > 2 * _endsCount)
     {
-        mainChain.insert(mainChain.begin(), pend[0]);
+        for (size_t i = 0; i < _endsCount; ++i)
+        {
+            out.putInt(container[i]);
+            out.put(' ');
+        }
+        out.put("[... ");
+        out.putUnsigned(n - 2 * _endsCount);
+        out.put(" more] ");
+        for (size_t i = n - _endsCount; i < n; ++i)
+        {
+            out.putInt(container[i]);
+            out.put(' ');
+        }
     }
-    
-    // STEP 5: INSERT REMAINING PEND USING JACOBSTHAL ORDER
-    if (pend.size() > 1)
+    else
     {
-        // Generate optimal insertion order based on Jacobsthal sequence
-        std::vector<size_t> insertionOrder = generateInsertionOrder(pend.size() - 1);
-        
-        // Insert each pend element according to the order
-        for (size_t i = 0; i < insertionOrder.size(); ++i)
+        for (size_t i = 0; i < n; ++i)
         {
-            size_t pendIndex = insertionOrder[i] + 1;  // +1 because already inserted pend[0]
-            int valueToInsert = pend[pendIndex];
-            
-            // Calculate maximum search position (maxPos)
-            // Formula: maxPos = pairedElementPos + elementsInserted
-            size_t pairedElementPos = pendIndex;
-            size_t elementsInserted = i + 1;
-            size_t maxPos = pairedElementPos + elementsInserted;
-            
-            binaryInsert(mainChain, valueToInsert, maxPos);
+            out.putInt(container[i]);
+            out.put(' ');
         }
     }
-    
-    // STEP 6: HANDLE STRAGGLER
-    // Insert the odd element (if any) using binary search over entire array
-    if (hasStraggler)
+    out.put('\n');
+}
+
+template <typename Container>
+void PmergeMe::printTime(double time, const Container &container, const std::string &containerName,
+                         const SortStats &stats)
+{
+    std::cout << "Time to process a range of " << container.size()
+              << " elements with std::" << containerName << ": "
+              << std::fixed << std::setprecision(5) << time << " us" << std::endl;
+    std::cout << "Arena for std::" << containerName << ": " << stats.levels
+              << " levels, " << stats.arenaAllocations << " buffers allocated, "
+              << stats.allocationsAvoided << " allocations avoided" << std::endl;
+    std::cout << "Comparisons with std::" << containerName << ": " << stats.comparisons
+              << " (Ford-Johnson bound: " << fordJohnsonBound(container.size()) << ")" << std::endl;
+    if (stats.distinct > 0)
+        std::cout << "Distinct values with std::" << containerName << ": " << stats.distinct
+                  << " of " << container.size() << " (compression ratio "
+                  << std::setprecision(1)
+                  << static_cast<double>(container.size()) / stats.distinct << ":1)"
+                  << std::endl;
+}
+
+// Machine-readable summary of an instrumented run: one "level" line per
+// recursion depth and one "total" line, as space separated key=value fields
+void PmergeMe::printStats(const SortStats &stats, size_t n, const std::string &containerName)
+{
+    size_t searches = 0;
+    size_t depthMax = 0;
+    for (size_t d = 0; d < stats.perLevel.size(); ++d)
     {
-        binaryInsert(mainChain, straggler, mainChain.size());
+        const LevelStats &level = stats.perLevel[d];
+        searches += level.searches;
+        if (level.searchDepthMax > depthMax)
+            depthMax = level.searchDepthMax;
+        std::cout << "stats container=" << containerName << " level=" << d
+                  << " size=" << level.size
+                  << " comparisons=" << level.comparisons
+                  << " searches=" << level.searches
+                  << " search_depth_total=" << level.searchDepthTotal
+                  << " search_depth_max=" << level.searchDepthMax
+                  << " tie_comparisons=" << level.tieComparisons
+                  << " moves=" << level.moves
+                  << " allocations=" << level.allocations
+                  << std::fixed << std::setprecision(1)
+                  << " pairing_us=" << level.pairingTime
+                  << " recursion_us=" << level.recursionTime
+                  << " insertion_us=" << level.insertionTime
+                  << " straggler_us=" << level.stragglerTime << std::endl;
     }
-    
-    // Replace original container with sorted result
-    container = mainChain;
+
+    size_t bound = fordJohnsonBound(n);
+    // log2(n!): no comparison sort can beat it in the worst case
+    double infoBound = 0;
+    for (size_t k = 2; k <= n; ++k)
+        infoBound += log(static_cast<double>(k));
+    infoBound /= log(2.0);
+    std::cout << "stats container=" << containerName << " total"
+              << " n=" << n
+              << " levels=" << stats.levels
+              << " comparisons=" << stats.comparisons
+              << " ford_johnson_bound=" << bound
+              << std::setprecision(1) << " log2_n_factorial=" << infoBound
+              << std::setprecision(4) << " bound_ratio="
+              << ((bound > 0) ? static_cast<double>(stats.comparisons) / bound : 0)
+              << " searches=" << searches
+              << " search_depth_max=" << depthMax
+              << " tie_comparisons=" << stats.tieComparisons
+              << " runs=" << stats.runs
+              << " run_elements=" << stats.runElements
+              << " run_comparisons=" << stats.runComparisons
+              << " distinct=" << stats.distinct
+              << " moves=" << stats.moves
+              << " allocations=" << stats.arenaAllocations << std::endl;
 }
 
-template <typename Container>
-void PmergeMe::printSortedSequence(const Container &container)
+// Per-phase timing over the trials: parsing ran once; copy-in and sort ran
+// once per trial
+void PmergeMe::printTiming(const TrialTimes &times, double parseTime, size_t n,
+                           const std::string &containerName)
 {
-    std::cout << "After:  ";
-    for (size_t i = 0; i < container.size(); ++i)
+    TimingSummary copyIn = summarizeTrials(times.copyIn);
+    TimingSummary sort = summarizeTrials(times.sort);
+    TimingSummary cycles = summarizeTrials(times.cycles);
+
+    if (_trials > 1)
     {
-        std::cout << container[i] << " ";
+        std::cout << "Timing with std::" << containerName << " over " << sort.trials
+                  << " trials: parse " << std::fixed << std::setprecision(1) << parseTime
+                  << " us, copy-in median " << copyIn.median << " us, sort min " << sort.min
+                  << " / median " << sort.median << " / mean " << sort.mean
+                  << " / stddev " << sort.stddev << " us";
+        if (sort.outliers > 0)
+            std::cout << " (outliers left out of mean and stddev: " << sort.outliers << ")";
+        std::cout << std::endl;
+        if (!times.cycles.empty())
+            std::cout << "Cycles with std::" << containerName << ": sort median "
+                      << std::setprecision(0) << cycles.median << " ("
+                      << std::setprecision(1) << (n > 0 ? cycles.median / n : 0)
+                      << " per element)" << std::endl;
     }
-    std::cout << std::endl;
+    if (_instrumented)
+        std::cout << "stats container=" << containerName << " timing"
+                  << " trials=" << sort.trials
+                  << " outliers=" << sort.outliers
+                  << std::fixed << std::setprecision(1)
+                  << " parse_us=" << parseTime
+                  << " copy_in_min_us=" << copyIn.min
+                  << " copy_in_median_us=" << copyIn.median
+                  << " sort_min_us=" << sort.min
+                  << " sort_median_us=" << sort.median
+                  << " sort_mean_us=" << sort.mean
+                  << " sort_stddev_us=" << sort.stddev
+                  << std::setprecision(0)
+                  << " sort_cycles_median=" << cycles.median << std::endl;
 }
 
 template <typename Container>
-void PmergeMe::printTime(double time, const Container &container, const std::string &containerName)
+void PmergeMe::printInitialSequence(const Container &container)
 {
-    std::cout << "Time to process a range of " << container.size()
-              << " elements with std::" << containerName << ": "
-              << std::fixed << std::setprecision(5) << time << " us" << std::endl;
+    writeSequence("Before: ", container);
 }
 
+// argv is echoed as typed in full mode; the other modes work on the values
 void PmergeMe::printInitialSequence(char **argv, int argc)
 {
-    std::cout << "Before: ";
+    if (_outputMode != OUTPUT_FULL)
+    {
+        writeSequence("Before: ", _vec);
+        return;
+    }
+
+    std::cout.flush();
+    OutputBuffer out(1);
+    out.put("Before: ");
     for (int i = 1; i < argc; ++i)
     {
-        std::cout << argv[i] << " ";
+        out.put(argv[i]);
+        out.put(' ');
     }
-    std::cout << std::endl;
+    out.put('\n');
 }
 
 void PmergeMe::sortAndMeasure(int argc, char **argv)
 {
     // Input validation and parsing
+    double parseStart = monotonicUs();
     for (int i = 1; i < argc; ++i)
     {
         std::string arg = argv[i];
@@ -262,22 +333,92 @@ void PmergeMe::sortAndMeasure(int argc, char **argv)
             return;
         }
         _vec.push_back(value);
-        _deq.push_back(value);
     }
+    double parseTime = monotonicUs() - parseStart;
 
     printInitialSequence(argv, argc);
+    measure(parseTime);
+}
 
-    clock_t start_vec = clock();
-    mergeInsertSort(_vec);
-    clock_t end_vec = clock();
-    double time_vec = static_cast<double>(end_vec - start_vec) / CLOCKS_PER_SEC * 1000000;
+// Same as above with the sequence read from a file ("-" for stdin), either
+// as whitespace separated text or as little-endian int32 binary
+void PmergeMe::sortAndMeasure(const std::string &path, bool binary)
+{
+    double parseStart = monotonicUs();
+    InputReader reader;
+    if (!reader.open(path)
+        || !(binary ? reader.parseBinary(_vec) : reader.parseText(_vec)))
+    {
+        std::cerr << reader.error() << std::endl;
+        return;
+    }
+    double parseTime = monotonicUs() - parseStart;
 
-    clock_t start_deq = clock();
-    mergeInsertSort(_deq);
-    clock_t end_deq = clock();
-    double time_deq = static_cast<double>(end_deq - start_deq) / CLOCKS_PER_SEC * 1000000;
+    printInitialSequence(_vec);
+    measure(parseTime);
+}
+
+// Out-of-core mode: sorts a file of any size into `outputPath` within
+// `memoryBytes` of working memory (see ExternalSort); false, with the
+// error printed, when it could not
+bool PmergeMe::sortExternal(const std::string &path, bool binary, const std::string &outputPath,
+                            size_t memoryBytes)
+{
+    ExternalSort external(*this, memoryBytes, _threads);
+    if (external.run(path, binary, outputPath))
+        return true;
+    std::cerr << external.error() << std::endl;
+    return false;
+}
+
+// One trial: fills `container` from scratch with the parsed input, then
+// sorts it, timing each step on the monotonic clock
+template <typename Container>
+void PmergeMe::runTrial(Container &container, const std::vector<int> &input, TrialTimes &times)
+{
+    Container().swap(container);
+    double start = monotonicUs();
+    container.assign(input.begin(), input.end());
+    double copied = monotonicUs();
+    unsigned long long cycles = readCycles();
+    if (_deduplicate)
+        mergeInsertSortDistinct(container);
+    else
+        mergeInsertSort(container);
+    cycles = readCycles() - cycles;
+    times.sort.push_back(monotonicUs() - copied);
+    times.copyIn.push_back(copied - start);
+    if (cyclesAvailable())
+        times.cycles.push_back(static_cast<double>(cycles));
+}
+
+// Sorts _vec and _deq `_trials` times each, alternating between them so
+// both see the same machine state, then prints the results. The reported
+// time is the median sort time; copying the input in is timed apart.
+void PmergeMe::measure(double parseTime)
+{
+    const std::vector<int> input(_vec);
+    TrialTimes times_vec;
+    TrialTimes times_deq;
+    SortStats stats_vec;
+    SortStats stats_deq;
+
+    for (size_t t = 0; t < _trials; ++t)
+    {
+        runTrial(_vec, input, times_vec);
+        stats_vec = _stats;
+        runTrial(_deq, input, times_deq);
+        stats_deq = _stats;
+    }
 
     printSortedSequence(_vec);
-    printTime(time_vec, _vec, "vector");
-    printTime(time_deq, _deq, "deque");
-}
\ No newline at end of file
+    printTime(summarizeTrials(times_vec.sort).median, _vec, "vector", stats_vec);
+    printTime(summarizeTrials(times_deq.sort).median, _deq, "deque", stats_deq);
+    printTiming(times_vec, parseTime, _vec.size(), "vector");
+    printTiming(times_deq, parseTime, _deq.size(), "deque");
+    if (_instrumented)
+    {
+        printStats(stats_vec, _vec.size(), "vector");
+        printStats(stats_deq, _deq.size(), "deque");
+    }
+}
@@ -7,9 +7,37 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
-#include <ctime>
 #include <iomanip>
 #include <cmath>
+#include <functional>
+#include <cstring>
+
+#include "KeyCounter.hpp"
+#include "SortArena.hpp"
+#include "InsertionOrder.hpp"
+#include "SortTasks.hpp"
+#include "SortRuns.hpp"
+#include "SortStats.hpp"
+#include "Timing.hpp"
+#include "ThreadPool.hpp"
+#include "InputReader.hpp"
+#include "OutputBuffer.hpp"
+#include "ExternalSort.hpp"
+
+// Levels smaller than this stay on the serial insertion path
+#define PARALLEL_THRESHOLD 4096
+
+// Levels smaller than this insert by shifting the chain: moving part of it
+// costs less than the bookkeeping that avoids it
+#define SHIFT_THRESHOLD 131072
+
+// How the Before/After sequences are printed
+enum OutputMode
+{
+    OUTPUT_FULL,        // every element
+    OUTPUT_ENDS,        // first and last K elements
+    OUTPUT_CHECKSUM     // element count, sum and order-sensitive hash only
+};
 
 class PmergeMe
 {
@@ -19,29 +47,653 @@ public:
     PmergeMe &operator=(const PmergeMe &other);
     ~PmergeMe();
 
+    void setInstrumented(bool instrumented);
+    void setThreads(size_t threads);
+    void setOutputMode(OutputMode mode, size_t endsCount);
+    void setTrials(size_t trials);
+    void setDeduplicate(bool deduplicate);
     void sortAndMeasure(int argc, char **argv);
+    void sortAndMeasure(const std::string &path, bool binary);
+    bool sortExternal(const std::string &path, bool binary, const std::string &outputPath,
+                      size_t memoryBytes);
+
+    // Library entry point: any random-access container, ordered by operator<
+    // or by `comp`. Elements are only compared and, at the end, swapped into
+    // place, so they need not be copyable cheaply (or at all, given a swap).
+    template <typename Container>
+    void mergeInsertSort(Container &container);
+    template <typename Container, typename Compare>
+    void mergeInsertSort(Container &container, Compare comp);
+    // Same result for containers of integers, with only the distinct values
+    // merge-insertion sorted: heavily repeated input sorts in time that
+    // grows with the distinct count rather than with n. Other element types
+    // are rejected at compile time (see IntegerKey).
+    template <typename Container>
+    void mergeInsertSortDistinct(Container &container);
+    const SortStats &lastStats() const;
+    static size_t fordJohnsonBound(size_t n);
 
 private:
     std::vector<int> _vec;
     std::deque<int> _deq;
+    SortStats _stats;
+    bool _instrumented;
+    size_t _threads;
+    OutputMode _outputMode;
+    size_t _endsCount;
+    size_t _trials;
+    bool _deduplicate;
 
-    std::vector<size_t> generateJacobsthalSequence(size_t maxSize);
-    
-    std::vector<size_t> generateInsertionOrder(size_t pendSize);
+    template <typename Less>
+    void sortRuns(size_t n, const Less &less, SortArena &arena);
 
-    template <typename Container>
-    void mergeInsertSort(Container &container);
+    template <typename Less>
+    void sortSegment(size_t begin, size_t end, const Less &less, SortArena &arena);
+
+    template <typename Less>
+    void mergeInsertLevel(size_t offset, size_t size, size_t permOffset,
+                          const Less &less, SortArena &arena);
+
+    template <typename Less>
+    void insertPendShifting(size_t offset, size_t size, const LevelPairs &pairs,
+                            const size_t *sortedPairs, size_t permOffset, const Less &less,
+                            LevelStats &level, SortArena &arena);
+
+    template <typename Less>
+    void insertPendSerial(size_t offset, size_t size, const LevelPairs &pairs,
+                          const size_t *sortedPairs, size_t permOffset, const Less &less,
+                          LevelStats &level, SortArena &arena);
+
+    template <typename Less>
+    void insertPendBlocked(size_t offset, size_t size, const LevelPairs &pairs,
+                           const size_t *sortedPairs, size_t permOffset, const Less &less,
+                           LevelStats &level, SortArena &arena);
+
+    static size_t buildChain(const LevelPairs &pairs, const size_t *sortedPairs, size_t size,
+                             SortArena &arena);
+
+    void measure(double parseTime);
 
     template <typename Container>
-    void binaryInsert(Container &container, int value, size_t maxPos);
+    void runTrial(Container &container, const std::vector<int> &input, TrialTimes &times);
 
     void printInitialSequence(char **argv, int argc);
 
+    template <typename Container>
+    void printInitialSequence(const Container &container);
+
     template <typename Container>
     void printSortedSequence(const Container &container);
 
     template <typename Container>
-    void printTime(double time, const Container &container, const std::string &containerName);
+    void writeSequence(const char *label, const Container &container);
+
+    template <typename Container>
+    void printTime(double time, const Container &container, const std::string &containerName,
+                   const SortStats &stats);
+
+    void printStats(const SortStats &stats, size_t n, const std::string &containerName);
+    void printTiming(const TrialTimes &times, double parseTime, size_t n,
+                     const std::string &containerName);
 };
 
-#endif
\ No newline at end of file
+template <typename Container>
+void PmergeMe::mergeInsertSort(Container &container)
+{
+    mergeInsertSort(container, std::less<typename Container::value_type>());
+}
+
+template <typename Container, typename Compare>
+void PmergeMe::mergeInsertSort(Container &container, Compare comp)
+{
+    size_t n = container.size();
+
+    // All working storage for every level is allocated here, once
+    SortArena arena(n, _instrumented);
+    ElementLess<typename Container::value_type, Compare> less(container, comp);
+    arena.stats.arenaAllocations += less.allocations();
+
+    ThreadPool *pool = NULL;
+    if (_threads > 1 && n >= PARALLEL_THRESHOLD)
+    {
+        pool = new ThreadPool(_threads);
+        arena.enableParallel(pool);
+    }
+
+    if (pool == NULL && n >= SHIFT_THRESHOLD)
+        arena.enableBlocks();
+
+    if (n > 1)
+    {
+        if (n >= ADAPTIVE_THRESHOLD)
+            sortRuns(n, less, arena);
+        else
+            mergeInsertLevel(0, n, 0, less, arena);
+
+        // perm[i] is the element that belongs at i. Following each cycle of
+        // the permutation with swaps moves every element once and never
+        // copies one (std::string and friends swap their buffers).
+        size_t *perm = &arena.perm[0];
+        size_t swaps = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            size_t j = i;
+            while (perm[j] != i)
+            {
+                size_t k = perm[j];
+                using std::swap;
+                swap(container[j], container[k]);
+                perm[j] = j;
+                j = k;
+                swaps++;
+            }
+            perm[j] = j;
+        }
+        arena.stats.moves += swaps;
+        if (_instrumented && !arena.stats.perLevel.empty())
+        {
+            arena.stats.perLevel[0].moves += swaps;
+            arena.stats.perLevel[0].allocations = arena.stats.arenaAllocations;
+        }
+    }
+    delete pool;
+    _stats = arena.finish();
+}
+
+// STEP 1 counts every value in a hash table, STEP 2 merge-insertion sorts
+// the distinct ones, STEP 3 writes each one back as many times as it was
+// counted. The stats are those of the distinct sort, plus the hashing and
+// the expansion.
+template <typename Container>
+void PmergeMe::mergeInsertSortDistinct(Container &container)
+{
+    typedef typename Container::value_type T;
+    size_t n = container.size();
+
+    // STEP 1: COLLAPSE DUPLICATES INTO (VALUE, COUNT)
+    KeyCounter<T> counter;
+    for (size_t i = 0; i < n; ++i)
+        counter.add(container[i]);
+
+    // STEP 2: SORT THE DISTINCT VALUES
+    std::vector<T> keys(counter.keys());
+    mergeInsertSort(keys);
+
+    // STEP 3: EXPAND
+    size_t out = 0;
+    for (size_t k = 0; k < keys.size(); ++k)
+    {
+        for (size_t c = counter.count(keys[k]); c > 0; --c)
+            container[out++] = keys[k];
+    }
+    _stats.distinct = keys.size();
+    _stats.moves += n;
+    _stats.arenaAllocations += counter.allocations() + 3;
+}
+
+// Adaptive front end for n >= ADAPTIVE_THRESHOLD: presorted runs of at
+// least MIN_RUN elements are kept as they are (descending ones reversed),
+// only the segments between them go through merge-insertion, and the sorted
+// segments are then merged. Nearly sorted input costs close to n
+// comparisons. The sorted ids are written to arena.perm[0, n).
+template <typename Less>
+void PmergeMe::sortRuns(size_t n, const Less &less, SortArena &arena)
+{
+    size_t *ids = &arena.chains[0];
+    size_t *buffer = &arena.chains[n];
+    std::vector<size_t> &ends = arena.runs;
+    ends.reserve(2 * (n / MIN_RUN) + 1);
+    arena.stats.arenaAllocations++;
+    size_t comparisons = 0;
+    size_t moves = 0;
+
+    // STEP 1: FIND THE RUNS, sorting the disorder in front of each one
+    size_t pos = 0;
+    size_t unsortedStart = 0;
+    size_t stride = 1;
+    while (pos + 1 < n)
+    {
+        bool descending;
+        size_t length = runLength(ids, pos, n, less, descending, comparisons);
+        if (length < MIN_RUN)
+        {
+            // Probe further and further ahead while there is only disorder
+            pos += std::max(length, stride);
+            stride = std::min(2 * stride, static_cast<size_t>(MAX_PROBE_STRIDE));
+            continue;
+        }
+        if (descending)
+            std::reverse(ids + pos, ids + pos + length);
+        if (unsortedStart < pos)
+        {
+            sortSegment(unsortedStart, pos, less, arena);
+            ends.push_back(pos);
+        }
+        pos += length;
+        ends.push_back(pos);
+        unsortedStart = pos;
+        stride = 1;
+        arena.stats.runs++;
+        arena.stats.runElements += length;
+    }
+    if (unsortedStart < n)
+    {
+        sortSegment(unsortedStart, n, less, arena);
+        ends.push_back(n);
+    }
+
+    // STEP 2: MERGE THE SORTED SEGMENTS
+    const size_t *sorted = mergeRuns(ids, buffer, ends, less, comparisons, moves);
+    std::copy(sorted, sorted + n, arena.perm.begin());
+
+    arena.stats.runComparisons += comparisons;
+    arena.stats.comparisons += comparisons;
+    arena.stats.moves += moves;
+}
+
+// Merge-insertion sorts the ids in arena.chains[begin, end) in place
+template <typename Less>
+void PmergeMe::sortSegment(size_t begin, size_t end, const Less &less, SortArena &arena)
+{
+    size_t size = end - begin;
+    if (size <= 1)
+        return;
+    mergeInsertLevel(begin, size, 0, less, arena);
+
+    // Deeper levels are done with the space behind the input ids
+    size_t *ids = &arena.chains[0];
+    size_t *sorted = &arena.chains[arena.chainsUsed];
+    for (size_t i = 0; i < size; ++i)
+        sorted[i] = ids[begin + arena.perm[i]];
+    std::copy(sorted, sorted + size, ids + begin);
+}
+
+// Sorts the elements whose ids are arena.chains[offset, offset + size): the
+// sorted order is written to arena.perm[permOffset, permOffset + size) as
+// indices relative to offset. Carrying this permutation up the recursion is
+// what links every larger element back to its pair, so no extra sort of the
+// pairs is needed.
+// Deeper levels work on slices of the arena, so no level allocates anything.
+template <typename Less>
+void PmergeMe::mergeInsertLevel(size_t offset, size_t size, size_t permOffset,
+                                const Less &less, SortArena &arena)
+{
+    // Base case: arrays of size 0 or 1 are already sorted
+    if (size <= 1)
+    {
+        if (size == 1)
+            arena.perm[permOffset] = 0;
+        return;
+    }
+    
+    size_t pairCount = size / 2;
+    size_t depth = arena.enterLevel(pairCount);
+    LevelStats level;
+    level.size = size;
+    double phaseStart = arena.instrumented ? monotonicUs() : 0;
+
+    // STEP 1: PAIRING PHASE
+    // Pairs are stored as parallel arrays: the larger elements become the
+    // next level's input in this level's slice of arena.chains, the smaller
+    // elements and the larger elements' indices go to the level's pair slices
+    size_t chainOffset = arena.chainsUsed;
+    arena.chainsUsed += pairCount;
+    LevelPairs pairs;
+    pairs.largerIndex = &arena.largerIndex[arena.pairsUsed];
+    pairs.smaller = &arena.smaller[arena.pairsUsed];
+    pairs.largerOffset = chainOffset;
+    arena.pairsUsed += pairCount;
+    
+    PairingJob<Less> pairing;
+    pairing.values = &arena.chains[offset];
+    pairing.pairs = pairs;
+    pairing.chains = &arena.chains[0];
+    pairing.less = &less;
+    if (arena.pool != NULL && size >= PARALLEL_THRESHOLD)
+        arena.pool->parallelFor(pairCount, &pairingTask<Less>, &pairing);
+    else
+        pairingTask<Less>(&pairing, 0, pairCount, 0);
+    level.comparisons += pairCount;
+    level.moves += pairCount;
+    
+    // An odd element (straggler) is the last index; it is inserted as the
+    // pend element that has no partner in the main chain
+    
+    if (arena.instrumented)
+    {
+        level.pairingTime = elapsedUs(phaseStart);
+        phaseStart = monotonicUs();
+    }
+    
+    // STEP 2: RECURSIVE SORT ON LARGER ELEMENTS
+    // childPerm[j] is the pair whose larger element is the j-th smallest
+    size_t childPerm = arena.permUsed;
+    arena.permUsed += pairCount;
+    mergeInsertLevel(chainOffset, pairCount, childPerm, less, arena);
+    const size_t *sortedPairs = &arena.perm[childPerm];
+
+    if (arena.instrumented)
+    {
+        level.recursionTime = elapsedUs(phaseStart);
+        phaseStart = monotonicUs();
+    }
+    
+    // STEPS 3-6: INSERT THE PEND ELEMENTS
+    if (arena.pool != NULL && size >= PARALLEL_THRESHOLD)
+        insertPendBlocked(offset, size, pairs, sortedPairs, permOffset, less, level, arena);
+    else if (size < SHIFT_THRESHOLD)
+        insertPendShifting(offset, size, pairs, sortedPairs, permOffset, less, level, arena);
+    else
+        insertPendSerial(offset, size, pairs, sortedPairs, permOffset, less, level, arena);
+
+    arena.stats.comparisons += level.comparisons;
+    arena.stats.tieComparisons += level.tieComparisons;
+    arena.stats.moves += level.moves;
+    if (arena.instrumented)
+    {
+        level.insertionTime = elapsedUs(phaseStart) - level.stragglerTime;
+        arena.stats.perLevel[depth].add(level);
+    }
+
+    // Hand this level's slices back to the arena
+    arena.permUsed = childPerm;
+    arena.chainsUsed = chainOffset;
+    arena.pairsUsed -= pairCount;
+    arena.leaveLevel();
+}
+
+// Exact Ford-Johnson insertion for small levels: every pend element is
+// binary searched in the chain, bounded by its partner's current position,
+// and the shorter side of the chain is moved one place to make room (the
+// buffer has space at both ends). That is O(n^2) moves, but of 32-bit level
+// indices with one memmove each, which below SHIFT_THRESHOLD is cheaper
+// than keeping the chain still. Only the partners in the current group need
+// their positions kept; everything past the group moves up by its size.
+template <typename Less>
+void PmergeMe::insertPendShifting(size_t offset, size_t size, const LevelPairs &pairs,
+                                  const size_t *sortedPairs, size_t permOffset, const Less &less,
+                                  LevelStats &level, SortArena &arena)
+{
+    size_t pairCount = size / 2;
+    size_t pendCount = size - pairCount;  // pairs + straggler
+    const size_t *ids = &arena.chains[offset];
+    unsigned int *chain = &arena.shifted[pendCount];
+    size_t *mainPos = &arena.mainPos[0];
+
+    // STEPS 3-4: BUILD THE CHAIN, b1 first (0 comparisons!) then the main chain
+    chain[0] = static_cast<unsigned int>(pairs.largerIndex[sortedPairs[0]] ^ 1);
+    for (size_t j = 0; j < pairCount; ++j)
+        chain[j + 1] = static_cast<unsigned int>(pairs.largerIndex[sortedPairs[j]]);
+    size_t length = pairCount + 1;
+    level.moves += length;
+
+    // STEP 5: INSERT REMAINING PEND USING JACOBSTHAL ORDER
+    for (InsertionOrder order(pendCount - 1); !order.done(); )
+    {
+        size_t groupBegin = order.groupBegin() + 1;  // +1 because b1 is already inserted
+        size_t groupEnd = order.groupEnd() + 1;
+        for (size_t j = groupBegin; j < groupEnd && j < pairCount; ++j)
+            mainPos[j] = j + 1 + (length - pairCount - 1);
+        size_t shift = 0;  // added to every mainPos of the group
+
+        for (; !order.done() && order.groupEnd() + 1 == groupEnd; ++order)
+        {
+            size_t pendIndex = *order + 1;
+            size_t index;
+            size_t bound;
+            double stragglerStart = 0;
+
+            if (pendIndex < pairCount)
+            {
+                // b <= its partner, so only the chain in front of it is searched
+                index = pairs.largerIndex[sortedPairs[pendIndex]] ^ 1;
+                bound = mainPos[pendIndex] + shift;
+            }
+            else
+            {
+                // STEP 6: HANDLE STRAGGLER (no partner, whole chain)
+                index = size - 1;
+                bound = length;
+                if (arena.instrumented)
+                    stragglerStart = monotonicUs();
+            }
+
+            size_t id = ids[index];
+            size_t left = 0;
+            size_t right = bound;
+            size_t depth = 0;
+            while (left < right)
+            {
+                size_t mid = left + (right - left) / 2;
+                depth++;
+                if (less(ids[chain[mid]], id))
+                    left = mid + 1;
+                else
+                    right = mid;
+            }
+            level.addSearch(depth);
+
+            if (left < length - left)
+            {
+                --chain;
+                std::memmove(chain, chain + 1, left * sizeof(*chain));
+            }
+            else
+                std::memmove(chain + left + 1, chain + left, (length - left) * sizeof(*chain));
+            chain[left] = static_cast<unsigned int>(index);
+            level.moves += std::min(left, length - left) + 1;
+            length++;
+            // The group's partners behind it have moved up as well; mostly
+            // that is all of them
+            if (pendIndex > groupBegin && mainPos[groupBegin] + shift >= left)
+                shift++;
+            else
+            {
+                for (size_t j = pendIndex; j > groupBegin && mainPos[j - 1] + shift >= left; --j)
+                    mainPos[j - 1]++;
+            }
+            if (pendIndex == pairCount && arena.instrumented)
+                level.stragglerTime = elapsedUs(stragglerStart);
+        }
+    }
+
+    // Write the sorted order into this level's permutation slice
+    size_t *perm = &arena.perm[permOffset];
+    for (size_t i = 0; i < length; ++i)
+        perm[i] = chain[i];
+}
+
+// Exact Ford-Johnson insertion for large levels, with the same searches as
+// insertPendShifting. The chain is a BlockChain, so an insertion moves at
+// most one block and a probe reads its position directly, however many
+// equal keys share the range. The group's partners stay consecutive in the
+// chain; a GapIndex over them counts what the group inserts in front of
+// each, which keeps their positions in O(log n) per insertion instead of
+// walking every partner behind the one landed in front of.
+template <typename Less>
+void PmergeMe::insertPendSerial(size_t offset, size_t size, const LevelPairs &pairs,
+                                const size_t *sortedPairs, size_t permOffset, const Less &less,
+                                LevelStats &level, SortArena &arena)
+{
+    size_t pairCount = size / 2;
+    size_t pendCount = size - pairCount;  // pairs + straggler
+    const size_t *ids = &arena.chains[offset];
+    BlockChain &chain = arena.blocks;
+    GapIndex &partners = arena.partners;
+
+    // STEPS 3-4: BUILD THE CHAIN, b1 first (0 comparisons!) then the main chain
+    chain.reset(size);
+    size_t first = sortedPairs[0];
+    chain.append(pairs.smaller[first], pairs.largerIndex[first] ^ 1);
+    for (size_t j = 0; j < pairCount; ++j)
+    {
+        size_t p = sortedPairs[j];
+        chain.append(arena.chains[pairs.largerOffset + p], pairs.largerIndex[p]);
+    }
+    size_t length = pairCount + 1;
+    level.moves += length;
+
+    // STEP 5: INSERT REMAINING PEND USING JACOBSTHAL ORDER
+    for (InsertionOrder order(pendCount - 1); !order.done(); )
+    {
+        size_t groupBegin = order.groupBegin() + 1;  // +1 because b1 is already inserted
+        size_t groupEnd = order.groupEnd() + 1;
+        // The group's partners sit together from `base` on, with what the
+        // group inserts in the gaps in front of them
+        size_t base = groupBegin + 1 + (length - pairCount - 1);
+        size_t partnerCount = std::min(groupEnd, pairCount) - std::min(groupBegin, pairCount);
+        partners.reset(partnerCount);
+
+        for (; !order.done() && order.groupEnd() + 1 == groupEnd; ++order)
+        {
+            size_t pendIndex = *order + 1;
+            size_t index;
+            size_t bound;
+            double stragglerStart = 0;
+
+            if (pendIndex < pairCount)
+            {
+                // b <= its partner, so only the chain in front of it is searched
+                index = pairs.largerIndex[sortedPairs[pendIndex]] ^ 1;
+                bound = base + partners.end(pendIndex - groupBegin);
+            }
+            else
+            {
+                // STEP 6: HANDLE STRAGGLER (no partner, whole chain)
+                index = size - 1;
+                bound = length;
+                if (arena.instrumented)
+                    stragglerStart = monotonicUs();
+            }
+
+            size_t id = ids[index];
+            size_t left = 0;
+            size_t right = bound;
+            size_t depth = 0;
+            while (left < right)
+            {
+                size_t mid = left + (right - left) / 2;
+                depth++;
+                if (less(chain.idAt(mid), id))
+                    left = mid + 1;
+                else
+                    right = mid;
+            }
+            level.addSearch(depth);
+
+            level.moves += chain.insert(left, id, index);
+            length++;
+            // Every partner from the one it landed in front of on has moved up
+            size_t position = (left > base) ? left - base : 0;
+            size_t gap = partnerCount;
+            if (position < partners.end(partnerCount))
+            {
+                size_t within;
+                gap = partners.find(position, within);
+            }
+            partners.add(gap);
+            if (pendIndex == pairCount && arena.instrumented)
+                level.stragglerTime = elapsedUs(stragglerStart);
+        }
+    }
+
+    // Write the sorted order into this level's permutation slice
+    chain.copyTo(&arena.perm[permOffset]);
+}
+
+// Parallel insertion, one Jacobsthal group at a time. The chain is a
+// contiguous array that is frozen while a group is placed: every element of
+// the group is binary searched in it concurrently (bounded by its partner's
+// position), elements that land in the same gap are ordered among
+// themselves, and the group is then merged in with one parallel pass. Groups
+// are O(log n), so data movement stays O(n log n). Elements that share a gap
+// were searched in a chain without each other, so ordering them is on top
+// of the exact Ford-Johnson count; --stats reports it as tie_comparisons.
+template <typename Less>
+void PmergeMe::insertPendBlocked(size_t offset, size_t size, const LevelPairs &pairs,
+                                 const size_t *sortedPairs, size_t permOffset, const Less &less,
+                                 LevelStats &level, SortArena &arena)
+{
+    size_t pairCount = size / 2;
+    size_t pendCount = size - pairCount;  // pairs + straggler
+    ChainItem *cur = &arena.blockA[0];
+    ChainItem *next = &arena.blockB[0];
+    size_t *mainRank = &arena.mainRank[0];
+    size_t *mainPos = &arena.mainPos[0];
+
+    // STEPS 3-4: BUILD THE CHAIN, b1 first (0 comparisons!) then the main chain
+    size_t length = buildChain(pairs, sortedPairs, size, arena);
+    level.moves += length;
+
+    // STEP 5: INSERT REMAINING PEND, GROUP BY GROUP
+    for (InsertionOrder order(pendCount - 1); !order.done(); order.nextGroup())
+    {
+        size_t groupSize = order.groupEnd() - order.groupBegin();
+
+        // Highest index first, as in the serial order
+        Placement *batch = &arena.batch[0];
+        for (size_t i = 0; i < groupSize; ++i)
+        {
+            size_t pendIndex = order.groupEnd() - i;  // (groupEnd - 1 - i) + 1 for b1
+            if (pendIndex < pairCount)
+            {
+                size_t p = sortedPairs[pendIndex];
+                batch[i].item = ChainItem(pairs.smaller[p], pairs.largerIndex[p] ^ 1);
+                batch[i].bound = mainPos[pendIndex];
+            }
+            else
+            {
+                // STEP 6: HANDLE STRAGGLER (no partner, whole chain)
+                batch[i].item = ChainItem(arena.chains[offset + size - 1], size - 1);
+                batch[i].bound = length;
+            }
+        }
+
+        // Search every element of the group in the frozen chain
+        SearchJob<Less> search;
+        search.chain = cur;
+        search.batch = batch;
+        search.workerStats = &arena.workerStats[0];
+        search.less = &less;
+        for (size_t w = 0; w < arena.workerStats.size(); ++w)
+            arena.workerStats[w] = LevelStats();
+        arena.pool->parallelFor(groupSize, &searchTask<Less>, &search);
+        for (size_t w = 0; w < arena.workerStats.size(); ++w)
+        {
+            const LevelStats &worker = arena.workerStats[w];
+            level.comparisons += worker.comparisons;
+            level.searches += worker.searches;
+            level.searchDepthTotal += worker.searchDepthTotal;
+            if (worker.searchDepthMax > level.searchDepthMax)
+                level.searchDepthMax = worker.searchDepthMax;
+        }
+
+        // Order the group by gap, then settle the elements that share one
+        std::sort(batch, batch + groupSize, gapThenBoundLess);
+        size_t ties = orderTies(batch, groupSize, less);
+        level.comparisons += ties;
+        level.tieComparisons += ties;
+
+        // Merge the group into the chain
+        MergeJob merge;
+        merge.chain = cur;
+        merge.length = length;
+        merge.batch = batch;
+        merge.batchSize = groupSize;
+        merge.out = next;
+        merge.mainRank = mainRank;
+        merge.mainPos = mainPos;
+        arena.pool->parallelFor(length + 1, &mergeTask, &merge);
+
+        std::swap(cur, next);
+        length += groupSize;
+        level.moves += length;
+    }
+
+    // Write the sorted order into this level's permutation slice
+    size_t *perm = &arena.perm[permOffset];
+    for (size_t i = 0; i < length; ++i)
+        perm[i] = cur[i].second;
+}
+
+#endif
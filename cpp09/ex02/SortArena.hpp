@@ -0,0 +1,154 @@
+#ifndef SORTARENA_HPP
+#define SORTARENA_HPP
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "BlockChain.hpp"
+#include "GapIndex.hpp"
+#include "SortStats.hpp"
+#include "ThreadPool.hpp"
+
+// A chain element: its element id and its index in the level being sorted
+typedef std::pair<size_t, size_t> ChainItem;
+
+// A pend element being inserted: searched in front of chain position
+// `bound`, lands in front of chain position `gap`
+struct Placement
+{
+    ChainItem item;
+    size_t bound;
+    size_t gap;
+};
+
+// One level's pairs in structure-of-arrays form, linked by pair index i.
+// The larger elements are the next level's input, at arena.chains[largerOffset + i];
+// the smaller ones sit densely in smaller[i]; largerIndex[i] is the level
+// index of the larger element (2i or 2i + 1, so the smaller one is ^ 1).
+// Elements are held as ids (positions in the caller's container).
+struct LevelPairs
+{
+    size_t *largerIndex;
+    size_t *smaller;
+    size_t largerOffset;
+};
+
+// Working storage for every recursion level of the merge-insertion sort.
+// Everything is sized once from the input length; each level takes its
+// slice of `chains`, the pair arrays and `perm` on the way down and gives it back on
+// the way up (stack discipline), and the insertion-phase buffers are shared
+// because a level only touches them after all deeper levels have returned.
+// Only element ids are stored, so one arena serves every element type.
+struct SortArena
+{
+    // Buffers a level allocated for itself before the arena existed:
+    // pairs, mainChain, pend, chain pool, mainNode (+ Jacobsthal, order)
+    static const size_t LEVEL_BUFFERS = 5;
+    static const size_t ORDER_BUFFERS = 2;
+    static const size_t ARENA_BUFFERS = 6;
+    static const size_t BLOCK_BUFFERS = 6;
+    static const size_t MERGING_BUFFERS = 4;
+    static const size_t PARALLEL_BUFFERS = 1;
+
+    std::vector<size_t> chains;             // input ids of every level, n + n/2 + ...
+    std::vector<size_t> largerIndex;        // pair -> larger element's index, every level
+    std::vector<size_t> smaller;            // pair -> smaller element's id, every level
+    std::vector<size_t> perm;               // sorted order of every level, n + n/2 + ...
+    std::vector<size_t> runs;               // sorted segment ends (adaptive path only)
+
+    // Insertion phase of the current level
+    std::vector<unsigned int> shifted;      // chain as level indices (small levels), 2n
+    std::vector<size_t> mainPos;            // main chain rank -> chain position
+
+    // Serial insertion of large levels only (see enableBlocks)
+    BlockChain blocks;                      // chain as (id, level index)
+    GapIndex partners;                      // current group's partners
+
+    // Parallel insertion of large levels only (see enableMerging)
+    std::vector<ChainItem> blockA;          // contiguous chain, swapped with
+    std::vector<ChainItem> blockB;          //   blockB after every group
+    std::vector<Placement> batch;           // current Jacobsthal group
+    std::vector<size_t> mainRank;           // level index -> main chain rank
+
+    // Parallel insertion only (see enableParallel)
+    ThreadPool *pool;
+    std::vector<LevelStats> workerStats;    // per-thread search counters
+
+    size_t chainsUsed;
+    size_t pairsUsed;
+    size_t permUsed;
+    size_t depth;
+    size_t replaced;
+    bool instrumented;
+    SortStats stats;
+
+    SortArena(size_t n, bool instrumented)
+        : chains(2 * n), largerIndex(n), smaller(n), perm(2 * n), shifted(2 * n), mainPos(n / 2),
+          pool(NULL), chainsUsed(n), pairsUsed(0), permUsed(0), depth(0), replaced(0), instrumented(instrumented)
+    {
+        // Level 0 sorts the elements in their original order
+        for (size_t i = 0; i < n; ++i)
+            chains[i] = i;
+        stats.arenaAllocations = ARENA_BUFFERS;
+    }
+
+    // Sizes the buffers of the serial insertion of large levels for n
+    // elements; sorts whose levels are all small never touch them
+    void enableBlocks()
+    {
+        size_t n = chains.size() / 2;
+        blocks = BlockChain(n);
+        partners = GapIndex(n / 2);
+        stats.arenaAllocations += BLOCK_BUFFERS;
+    }
+
+    // Sizes the buffers of the merging insertion for n elements
+    void enableMerging()
+    {
+        size_t n = chains.size() / 2;
+        blockA.resize(n);
+        blockB.resize(n);
+        batch.resize(n / 2 + 1);
+        mainRank.resize(n);
+        stats.arenaAllocations += MERGING_BUFFERS;
+    }
+
+    // Hands the insertion phase a pool of threads
+    void enableParallel(ThreadPool *threadPool)
+    {
+        enableMerging();
+        pool = threadPool;
+        workerStats.resize(pool->size());
+        stats.arenaAllocations += PARALLEL_BUFFERS;
+    }
+
+    // Returns the depth of the level being entered; the level calls
+    // leaveLevel() on its way out
+    size_t enterLevel(size_t pairCount)
+    {
+        size_t level = depth++;
+        if (depth > stats.levels)
+            stats.levels = depth;
+        replaced += LEVEL_BUFFERS;
+        if (pairCount > 1)
+            replaced += ORDER_BUFFERS;
+        if (instrumented && stats.perLevel.size() < stats.levels)
+            stats.perLevel.resize(stats.levels);
+        return level;
+    }
+
+    void leaveLevel()
+    {
+        depth--;
+    }
+
+    const SortStats &finish()
+    {
+        stats.allocationsAvoided = (replaced > stats.arenaAllocations)
+                                       ? replaced - stats.arenaAllocations : 0;
+        return stats;
+    }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef SORTRUNS_HPP
+#define SORTRUNS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// Runs shorter than this are treated as disorder and merge-insertion sorted
+#define MIN_RUN 32
+
+// Inputs shorter than this skip run detection. Probing random input costs a
+// few dozen comparisons, which only stays within the Ford-Johnson bound's
+// slack once inputs are a few thousand long.
+#define ADAPTIVE_THRESHOLD 2048
+
+// Inside disorder, run probes move ahead by a doubling stride capped here:
+// random input pays about 2 comparisons per MAX_PROBE_STRIDE elements
+#define MAX_PROBE_STRIDE 1024
+
+// Length of the run starting at ids[pos]: ascending (equal elements allowed)
+// or strictly descending, in which case `descending` is set
+template <typename Less>
+size_t runLength(const size_t *ids, size_t pos, size_t n, const Less &less,
+                 bool &descending, size_t &comparisons)
+{
+    size_t end = pos + 1;
+    comparisons++;
+    descending = less(ids[end], ids[pos]);
+    ++end;
+    while (end < n)
+    {
+        comparisons++;
+        if (less(ids[end], ids[end - 1]) != descending)
+            break;
+        ++end;
+    }
+    return end - pos;
+}
+
+// First position in ids[lo, hi) whose element is greater than `id`
+template <typename Less>
+size_t upperBound(const size_t *ids, size_t lo, size_t hi, size_t id, const Less &less,
+                  size_t &comparisons)
+{
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        comparisons++;
+        if (less(id, ids[mid]))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// First position in ids[lo, hi) whose element is not less than `id`
+template <typename Less>
+size_t lowerBound(const size_t *ids, size_t lo, size_t hi, size_t id, const Less &less,
+                  size_t &comparisons)
+{
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        comparisons++;
+        if (less(ids[mid], id))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Merges the sorted ranges src[begin, mid) and src[mid, end) into
+// out[begin, end). The front of the first range that is <= the second's
+// first element and the back of the second that is >= the first's last
+// element are found by binary search and copied as they are, so runs that
+// barely overlap cost a few comparisons instead of one per element.
+template <typename Less>
+void mergeRunPair(const size_t *src, size_t begin, size_t mid, size_t end, size_t *out,
+                  const Less &less, size_t &comparisons)
+{
+    comparisons++;
+    if (!less(src[mid], src[mid - 1]))
+    {
+        std::copy(src + begin, src + end, out + begin);
+        return;
+    }
+    size_t a = upperBound(src, begin, mid - 1, src[mid], less, comparisons);
+    size_t bEnd = lowerBound(src, mid + 1, end, src[mid - 1], less, comparisons);
+    size_t b = mid;
+    size_t o = begin;
+
+    std::copy(src + begin, src + a, out + o);
+    o += a - begin;
+    while (a < mid && b < bEnd)
+    {
+        comparisons++;
+        if (less(src[b], src[a]))
+            out[o++] = src[b++];
+        else
+            out[o++] = src[a++];
+    }
+    std::copy(src + a, src + mid, out + o);
+    o += mid - a;
+    std::copy(src + b, src + end, out + o);
+}
+
+// Merges adjacent sorted segments pairwise until one is left. `ends` holds
+// the segment ends (the last is n) and is updated as segments merge; `ids`
+// and `buffer` are both n long, and the result is left in one of them,
+// which is returned.
+template <typename Less>
+size_t *mergeRuns(size_t *ids, size_t *buffer, std::vector<size_t> &ends, const Less &less,
+                  size_t &comparisons, size_t &moves)
+{
+    size_t *src = ids;
+    size_t *dst = buffer;
+    while (ends.size() > 1)
+    {
+        size_t kept = 0;
+        size_t begin = 0;
+        for (size_t i = 0; i < ends.size(); i += 2)
+        {
+            if (i + 1 < ends.size())
+            {
+                mergeRunPair(src, begin, ends[i], ends[i + 1], dst, less, comparisons);
+                ends[kept++] = ends[i + 1];
+            }
+            else
+            {
+                std::copy(src + begin, src + ends[i], dst + begin);
+                ends[kept++] = ends[i];
+            }
+            begin = ends[kept - 1];
+        }
+        moves += begin;
+        ends.resize(kept);
+        std::swap(src, dst);
+    }
+    return src;
+}
+
+#endif
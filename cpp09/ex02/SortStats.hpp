@@ -0,0 +1,78 @@
+#ifndef SORTSTATS_HPP
+#define SORTSTATS_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Counters and phase times of one recursion level (instrumented runs only).
+// Times are in microseconds; recursionTime includes every deeper level.
+struct LevelStats
+{
+    size_t size;                // elements sorted by this level
+    size_t comparisons;         // pairing + binary searches
+    size_t searches;            // binary searches performed
+    size_t searchDepthTotal;    // comparisons spent in those searches
+    size_t searchDepthMax;      // deepest single search
+    size_t tieComparisons;      // ordering elements that shared a gap (threaded only)
+    size_t moves;               // element values copied
+    size_t allocations;         // buffers allocated by this level
+    double pairingTime;
+    double recursionTime;
+    double insertionTime;       // chain build + pend insertion
+    double stragglerTime;
+
+    LevelStats()
+        : size(0), comparisons(0), searches(0), searchDepthTotal(0), searchDepthMax(0),
+          tieComparisons(0), moves(0), allocations(0), pairingTime(0), recursionTime(0),
+          insertionTime(0), stragglerTime(0) {}
+
+    // One binary search that took `depth` comparisons
+    void addSearch(size_t depth)
+    {
+        comparisons += depth;
+        searches++;
+        searchDepthTotal += depth;
+        if (depth > searchDepthMax)
+            searchDepthMax = depth;
+    }
+
+    // Folds in another call at the same depth (one per sorted segment)
+    void add(const LevelStats &other)
+    {
+        size += other.size;
+        comparisons += other.comparisons;
+        searches += other.searches;
+        searchDepthTotal += other.searchDepthTotal;
+        if (other.searchDepthMax > searchDepthMax)
+            searchDepthMax = other.searchDepthMax;
+        tieComparisons += other.tieComparisons;
+        moves += other.moves;
+        allocations += other.allocations;
+        pairingTime += other.pairingTime;
+        recursionTime += other.recursionTime;
+        insertionTime += other.insertionTime;
+        stragglerTime += other.stragglerTime;
+    }
+};
+
+// Counters collected by one run of PmergeMe::mergeInsertSort
+struct SortStats
+{
+    size_t levels;              // deepest recursion level that had at least one pair
+    size_t arenaAllocations;    // buffers allocated up front by the SortArena
+    size_t allocationsAvoided;  // per-level buffers the arena replaced
+    size_t comparisons;         // element comparisons, all phases
+    size_t tieComparisons;      // of those, ordering elements that shared a gap
+    size_t moves;               // element values copied
+    size_t runs;                // presorted runs kept as they were
+    size_t runElements;         // elements in those runs
+    size_t runComparisons;      // run detection and run merging
+    size_t distinct;            // distinct keys sorted (deduplicating sort only, else 0)
+    std::vector<LevelStats> perLevel;  // indexed by depth, filled when instrumented
+
+    SortStats()
+        : levels(0), arenaAllocations(0), allocationsAvoided(0), comparisons(0), tieComparisons(0),
+          moves(0), runs(0), runElements(0), runComparisons(0), distinct(0) {}
+};
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef SORTTASKS_HPP
+#define SORTTASKS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+#include "SortArena.hpp"
+#include "SortStats.hpp"
+#include "Timing.hpp"
+
+// Microseconds of wall time since `start` (a monotonicUs() reading)
+inline double elapsedUs(double start)
+{
+    return monotonicUs() - start;
+}
+
+// Strict weak order on element ids. The engine only ever moves ids around;
+// this is the one place that looks at the elements themselves. Contiguous
+// storage is indexed directly; anything else (std::deque) goes through a
+// table of element addresses, built once.
+template <typename T, typename Compare>
+class ElementLess
+{
+public:
+    template <typename Container>
+    ElementLess(const Container &container, Compare comp) : _base(NULL), _comp(comp)
+    {
+        size_t n = container.size();
+        if (n == 0)
+            return;
+        const T *base = &container[0];
+        size_t i = 1;
+        while (i < n && &container[i] == base + i)
+            ++i;
+        if (i == n)
+        {
+            _base = base;
+            return;
+        }
+        _table.resize(n);
+        for (i = 0; i < n; ++i)
+            _table[i] = &container[i];
+    }
+
+    // Buffers allocated for the lookup (0 or 1)
+    size_t allocations() const
+    {
+        return _table.empty() ? 0 : 1;
+    }
+
+    bool operator()(size_t a, size_t b) const
+    {
+        if (_base != NULL)
+            return _comp(_base[a], _base[b]);
+        return _comp(*_table[a], *_table[b]);
+    }
+
+private:
+    const T *_base;
+    std::vector<const T *> _table;
+    Compare _comp;
+};
+
+// Pairs are independent, so any range of them can be formed on any thread
+template <typename Less>
+struct PairingJob
+{
+    const size_t *values;
+    LevelPairs pairs;
+    size_t *chains;
+    const Less *less;
+};
+
+template <typename Less>
+void pairingTask(void *context, size_t begin, size_t end, size_t)
+{
+    PairingJob<Less> *job = static_cast<PairingJob<Less> *>(context);
+    const Less &less = *job->less;
+
+    // Create pairs and sort each pair internally (one comparison each)
+    for (size_t i = begin; i < end; ++i)
+    {
+        size_t larger = 2 * i + 1;
+        size_t low = job->values[2 * i];
+        size_t high = job->values[larger];
+        if (less(high, low))
+        {
+            std::swap(low, high);
+            larger = 2 * i;
+        }
+        job->pairs.largerIndex[i] = larger;
+        job->pairs.smaller[i] = low;
+        job->chains[job->pairs.largerOffset + i] = high;
+    }
+}
+
+template <typename Less>
+struct SearchJob
+{
+    const ChainItem *chain;
+    Placement *batch;
+    LevelStats *workerStats;
+    const Less *less;
+};
+
+// Binary search of batch[begin, end) in the frozen chain, each within [0, bound)
+template <typename Less>
+void searchTask(void *context, size_t begin, size_t end, size_t worker)
+{
+    SearchJob<Less> *job = static_cast<SearchJob<Less> *>(context);
+    const Less &less = *job->less;
+    LevelStats &stats = job->workerStats[worker];
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        Placement &placement = job->batch[i];
+        size_t left = 0;
+        size_t right = placement.bound;
+        size_t depth = 0;
+        while (left < right)
+        {
+            size_t mid = left + (right - left) / 2;
+            depth++;
+            if (less(job->chain[mid].first, placement.item.first))
+                left = mid + 1;
+            else
+                right = mid;
+        }
+        placement.gap = left;
+        stats.addSearch(depth);
+    }
+}
+
+struct MergeJob
+{
+    const ChainItem *chain;
+    size_t length;
+    const Placement *batch;
+    size_t batchSize;
+    ChainItem *out;
+    const size_t *mainRank;
+    size_t *mainPos;
+};
+
+// Orders a group by gap, and elements that share a gap in the serial order.
+// Within a group that is the order of decreasing bounds (partner positions
+// grow with the pend index, and the straggler's bound is the whole chain),
+// so no element is compared.
+inline bool gapThenBoundLess(const Placement &a, const Placement &b)
+{
+    if (a.gap != b.gap)
+        return a.gap < b.gap;
+    return a.bound > b.bound;
+}
+
+// Orders the elements of batch[0, size) (sorted by gapThenBoundLess) that
+// share a gap: each is binary inserted among the ones before it, which is
+// what the serial search would have to settle. Returns the comparisons.
+template <typename Less>
+size_t orderTies(Placement *batch, size_t size, const Less &less)
+{
+    size_t comparisons = 0;
+    size_t begin = 0;
+    for (size_t i = 1; i < size; ++i)
+    {
+        if (batch[i].gap != batch[begin].gap)
+        {
+            begin = i;
+            continue;
+        }
+        Placement placement = batch[i];
+        size_t left = begin;
+        size_t right = i;
+        while (left < right)
+        {
+            size_t mid = left + (right - left) / 2;
+            comparisons++;
+            if (less(batch[mid].item.first, placement.item.first))
+                left = mid + 1;
+            else
+                right = mid;
+        }
+        std::copy_backward(batch + left, batch + i, batch + i + 1);
+        batch[left] = placement;
+    }
+    return comparisons;
+}
+
+inline bool gapLess(const Placement &placement, size_t gap)
+{
+    return placement.gap < gap;
+}
+
+// Writes chain gaps [begin, end) and the batch elements that land in them.
+// Everything in front of gap p is p chain elements plus the batch elements
+// with a smaller gap, so each range knows its output offset up front.
+inline void mergeTask(void *context, size_t begin, size_t end, size_t)
+{
+    MergeJob *job = static_cast<MergeJob *>(context);
+    const Placement *batchEnd = job->batch + job->batchSize;
+    const Placement *placement = std::lower_bound(job->batch, batchEnd, begin, gapLess);
+    size_t out = begin + (placement - job->batch);
+
+    for (size_t p = begin; p < end; ++p)
+    {
+        while (placement != batchEnd && placement->gap == p)
+        {
+            job->out[out++] = placement->item;
+            ++placement;
+        }
+        if (p < job->length)
+        {
+            const ChainItem &item = job->chain[p];
+            size_t j = job->mainRank[item.second];
+            if (j != static_cast<size_t>(-1))
+                job->mainPos[j] = out;
+            job->out[out++] = item;
+        }
+    }
+}
+
+#endif
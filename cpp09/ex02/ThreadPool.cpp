@@ -0,0 +1,114 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(size_t threads)
+    : _task(NULL), _context(NULL), _count(0), _generation(0), _pending(0), _stop(false)
+{
+    if (threads == 0)
+        threads = 1;
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_wake, NULL);
+    pthread_cond_init(&_done, NULL);
+
+    // Worker 0 is the calling thread, so only threads - 1 are spawned
+    _args.resize(threads);
+    _workers.resize(threads - 1);
+    for (size_t i = 0; i < threads; ++i)
+    {
+        _args[i].pool = this;
+        _args[i].worker = i;
+    }
+    for (size_t i = 1; i < threads; ++i)
+    {
+        if (pthread_create(&_workers[i - 1], NULL, &ThreadPool::workerMain, &_args[i]) != 0)
+        {
+            // Fall back to the threads that did start
+            _workers.resize(i - 1);
+            _args.resize(i);
+            break;
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&_mutex);
+    _stop = true;
+    pthread_cond_broadcast(&_wake);
+    pthread_mutex_unlock(&_mutex);
+
+    for (size_t i = 0; i < _workers.size(); ++i)
+        pthread_join(_workers[i], NULL);
+
+    pthread_cond_destroy(&_done);
+    pthread_cond_destroy(&_wake);
+    pthread_mutex_destroy(&_mutex);
+}
+
+size_t ThreadPool::size() const
+{
+    return _args.size();
+}
+
+void ThreadPool::runChunk(size_t worker)
+{
+    size_t threads = _args.size();
+    size_t begin = _count * worker / threads;
+    size_t end = _count * (worker + 1) / threads;
+    if (begin < end)
+        _task(_context, begin, end, worker);
+}
+
+void ThreadPool::parallelFor(size_t count, Task task, void *context)
+{
+    if (_workers.empty())
+    {
+        if (count > 0)
+            task(context, 0, count, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    _task = task;
+    _context = context;
+    _count = count;
+    _pending = _workers.size();
+    _generation++;
+    pthread_cond_broadcast(&_wake);
+    pthread_mutex_unlock(&_mutex);
+
+    runChunk(0);
+
+    pthread_mutex_lock(&_mutex);
+    while (_pending > 0)
+        pthread_cond_wait(&_done, &_mutex);
+    pthread_mutex_unlock(&_mutex);
+}
+
+void *ThreadPool::workerMain(void *arg)
+{
+    WorkerArg *self = static_cast<WorkerArg *>(arg);
+    ThreadPool *pool = self->pool;
+    size_t seen = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->_mutex);
+        while (pool->_generation == seen && !pool->_stop)
+            pthread_cond_wait(&pool->_wake, &pool->_mutex);
+        if (pool->_stop)
+        {
+            pthread_mutex_unlock(&pool->_mutex);
+            break;
+        }
+        seen = pool->_generation;
+        pthread_mutex_unlock(&pool->_mutex);
+
+        pool->runChunk(self->worker);
+
+        pthread_mutex_lock(&pool->_mutex);
+        if (--pool->_pending == 0)
+            pthread_cond_signal(&pool->_done);
+        pthread_mutex_unlock(&pool->_mutex);
+    }
+    return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+// Fixed set of worker threads for data-parallel loops. parallelFor splits
+// [0, count) into one contiguous chunk per thread, runs chunk 0 on the
+// calling thread and returns once every chunk is done.
+class ThreadPool
+{
+private:
+    ThreadPool(const ThreadPool &other);
+    ThreadPool &operator=(const ThreadPool &other);
+
+public:
+    typedef void (*Task)(void *context, size_t begin, size_t end, size_t worker);
+
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    size_t size() const;
+    void parallelFor(size_t count, Task task, void *context);
+
+private:
+    std::vector<pthread_t> _workers;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _wake;
+    pthread_cond_t _done;
+
+    Task _task;
+    void *_context;
+    size_t _count;
+    size_t _generation;
+    size_t _pending;
+    bool _stop;
+
+    struct WorkerArg
+    {
+        ThreadPool *pool;
+        size_t worker;
+    };
+    std::vector<WorkerArg> _args;
+
+    static void *workerMain(void *arg);
+    void runChunk(size_t worker);
+};
+
+#endif
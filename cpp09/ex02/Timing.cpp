@@ -0,0 +1,84 @@
+#include "Timing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+double monotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+unsigned long long readCycles()
+{
+    unsigned int low;
+    unsigned int high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return (static_cast<unsigned long long>(high) << 32) | low;
+}
+
+bool cyclesAvailable()
+{
+    return true;
+}
+
+#else
+
+unsigned long long readCycles()
+{
+    return 0;
+}
+
+bool cyclesAvailable()
+{
+    return false;
+}
+
+#endif
+
+static double median(const std::vector<double> &sorted)
+{
+    size_t n = sorted.size();
+    if (n % 2 == 1)
+        return sorted[n / 2];
+    return (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+TimingSummary summarizeTrials(std::vector<double> samples)
+{
+    TimingSummary summary;
+    summary.trials = samples.size();
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    summary.min = samples[0];
+    summary.median = median(samples);
+
+    // Timing noise only ever adds time, so only the slow side is trimmed.
+    // 1.4826 scales the MAD to a standard deviation for normal noise.
+    std::vector<double> deviations(samples.size());
+    for (size_t i = 0; i < samples.size(); ++i)
+        deviations[i] = std::fabs(samples[i] - summary.median);
+    std::sort(deviations.begin(), deviations.end());
+    double limit = summary.median + OUTLIER_MADS * 1.4826 * median(deviations);
+
+    size_t kept = samples.size();
+    while (kept > 1 && samples[kept - 1] > limit)
+        --kept;
+    summary.outliers = samples.size() - kept;
+
+    double sum = 0;
+    for (size_t i = 0; i < kept; ++i)
+        sum += samples[i];
+    summary.mean = sum / kept;
+    double squares = 0;
+    for (size_t i = 0; i < kept; ++i)
+        squares += (samples[i] - summary.mean) * (samples[i] - summary.mean);
+    summary.stddev = (kept > 1) ? std::sqrt(squares / (kept - 1)) : 0;
+    return summary;
+}
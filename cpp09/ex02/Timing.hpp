@@ -0,0 +1,45 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Samples further than this many (normalised) median absolute deviations
+// above the median are outliers: page faults, preemption, a cold cache
+#define OUTLIER_MADS 3.0
+
+// Microseconds on the monotonic clock. Unlike clock(), this is wall time at
+// nanosecond resolution, and it does not add up the CPU time of the worker
+// threads.
+double monotonicUs();
+
+// CPU time-stamp counter (rdtsc), or 0 where there is none
+unsigned long long readCycles();
+bool cyclesAvailable();
+
+// Per-phase samples of repeated trials on one container, one per trial.
+// cycles stays empty without a time-stamp counter.
+struct TrialTimes
+{
+    std::vector<double> copyIn;
+    std::vector<double> sort;
+    std::vector<double> cycles;
+};
+
+// Summary of one phase over all trials. min and median use every sample;
+// mean and stddev leave out the outliers above the median.
+struct TimingSummary
+{
+    size_t trials;
+    size_t outliers;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+
+    TimingSummary() : trials(0), outliers(0), min(0), median(0), mean(0), stddev(0) {}
+};
+
+TimingSummary summarizeTrials(std::vector<double> samples);
+
+#endif
@@ -0,0 +1,275 @@
+#include "PmergeMe.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+// Benchmark harness for PmergeMe::mergeInsertSort. For every distribution
+// and size it runs warmup + timed trials of merge-insertion on std::vector
+// and std::deque, and the same input through std::sort and std::stable_sort,
+// then prints one CSV row per (container, distribution, size).
+
+struct BenchConfig
+{
+    std::vector<std::string> distributions;
+    std::vector<size_t> sizes;
+    size_t trials;
+    size_t warmup;
+    size_t threads;
+
+    BenchConfig() : trials(5), warmup(1), threads(1) {}
+};
+
+// Deterministic xorshift64, so every run sees the same inputs
+class Random
+{
+public:
+    explicit Random(unsigned long seed) : _state(seed ? seed : 88172645463325252UL) {}
+
+    unsigned long next()
+    {
+        _state ^= _state << 13;
+        _state ^= _state >> 7;
+        _state ^= _state << 17;
+        return _state;
+    }
+
+private:
+    unsigned long _state;
+};
+
+static bool makeInput(const std::string &distribution, size_t n, std::vector<int> &out)
+{
+    Random random(n * 2654435761UL + distribution.size());
+    out.resize(n);
+
+    if (distribution == "random")
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>(random.next() & 0x7fffffff);
+    }
+    else if (distribution == "sorted")
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>(i);
+    }
+    else if (distribution == "reverse")
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>(n - i);
+    }
+    else if (distribution == "organ-pipe")
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>(i < n / 2 ? i : n - i);
+    }
+    else if (distribution == "few-unique")
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>(random.next() % 16);
+    }
+    else if (distribution == "two-valued")
+    {
+        // 0 or 1: long runs of equal keys in every search range
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>((random.next() >> 17) & 1);
+    }
+    else if (distribution == "nearly-sorted")
+    {
+        // sorted, then 1% of the positions swapped with a random partner
+        for (size_t i = 0; i < n; ++i)
+            out[i] = static_cast<int>(i);
+        for (size_t k = 0; k < n / 100 + 1 && n > 1; ++k)
+            std::swap(out[random.next() % n], out[random.next() % n]);
+    }
+    else
+        return false;
+    return true;
+}
+
+// Comparator that counts its calls, for the std::sort comparison columns
+class CountingLess
+{
+public:
+    explicit CountingLess(size_t *count) : _count(count) {}
+    bool operator()(int a, int b) const
+    {
+        ++*_count;
+        return a < b;
+    }
+
+private:
+    size_t *_count;
+};
+
+struct Sample
+{
+    double median;
+    double p95;
+    size_t comparisons;
+};
+
+static Sample summarize(std::vector<double> &times, size_t comparisons)
+{
+    std::sort(times.begin(), times.end());
+    Sample sample;
+    sample.median = times[times.size() / 2];
+    size_t p95 = (times.size() * 95 + 99) / 100;
+    sample.p95 = times[(p95 > 0 ? p95 : 1) - 1];
+    sample.comparisons = comparisons;
+    return sample;
+}
+
+template <typename Container>
+static Sample timeMergeInsert(PmergeMe &sorter, const std::vector<int> &input,
+                              const BenchConfig &config)
+{
+    std::vector<double> times;
+    for (size_t t = 0; t < config.warmup + config.trials; ++t)
+    {
+        Container data(input.begin(), input.end());
+        double start = monotonicUs();
+        sorter.mergeInsertSort(data);
+        double elapsed = monotonicUs() - start;
+        if (t >= config.warmup)
+            times.push_back(elapsed);
+    }
+    return summarize(times, sorter.lastStats().comparisons);
+}
+
+template <typename Container>
+static Sample timeStdSort(const std::vector<int> &input, const BenchConfig &config, bool stable)
+{
+    std::vector<double> times;
+    for (size_t t = 0; t < config.warmup + config.trials; ++t)
+    {
+        Container data(input.begin(), input.end());
+        double start = monotonicUs();
+        if (stable)
+            std::stable_sort(data.begin(), data.end());
+        else
+            std::sort(data.begin(), data.end());
+        double elapsed = monotonicUs() - start;
+        if (t >= config.warmup)
+            times.push_back(elapsed);
+    }
+
+    // Comparisons are counted in a separate, untimed run
+    size_t comparisons = 0;
+    Container data(input.begin(), input.end());
+    if (stable)
+        std::stable_sort(data.begin(), data.end(), CountingLess(&comparisons));
+    else
+        std::sort(data.begin(), data.end(), CountingLess(&comparisons));
+    return summarize(times, comparisons);
+}
+
+template <typename Container>
+static void benchContainer(PmergeMe &sorter, const std::string &containerName,
+                           const std::string &distribution, const std::vector<int> &input,
+                           const BenchConfig &config)
+{
+    Sample merge = timeMergeInsert<Container>(sorter, input, config);
+    Sample quick = timeStdSort<Container>(input, config, false);
+    Sample stable = timeStdSort<Container>(input, config, true);
+
+    std::cout << containerName << ',' << distribution << ',' << input.size() << ','
+              << config.trials << ','
+              << std::fixed << std::setprecision(1)
+              << merge.median << ',' << merge.p95 << ','
+              << merge.comparisons << ',' << PmergeMe::fordJohnsonBound(input.size()) << ','
+              << quick.median << ',' << quick.comparisons << ','
+              << stable.median << ',' << stable.comparisons << ','
+              << std::setprecision(3)
+              << (quick.median > 0 ? merge.median / quick.median : 0) << ','
+              << (stable.median > 0 ? merge.median / stable.median : 0) << std::endl;
+}
+
+static void splitList(const std::string &list, std::vector<std::string> &out)
+{
+    out.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            out.push_back(item);
+}
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--dist LIST] [--sizes LIST] [--max-size N]"
+              << " [--trials N] [--warmup N] [--threads N]" << std::endl
+              << "  LIST is comma separated; distributions: random, sorted, reverse,"
+              << " organ-pipe, few-unique, two-valued, nearly-sorted" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+    size_t maxSize = 1000000;
+    splitList("random,sorted,reverse,organ-pipe,few-unique,two-valued,nearly-sorted",
+              config.distributions);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--dist")
+            splitList(value, config.distributions);
+        else if (option == "--sizes")
+        {
+            std::vector<std::string> sizes;
+            splitList(value, sizes);
+            for (size_t k = 0; k < sizes.size(); ++k)
+                config.sizes.push_back(static_cast<size_t>(std::atol(sizes[k].c_str())));
+        }
+        else if (option == "--max-size")
+            maxSize = static_cast<size_t>(std::atol(value.c_str()));
+        else if (option == "--trials")
+            config.trials = static_cast<size_t>(std::atol(value.c_str()));
+        else if (option == "--warmup")
+            config.warmup = static_cast<size_t>(std::atol(value.c_str()));
+        else if (option == "--threads")
+            config.threads = static_cast<size_t>(std::atol(value.c_str()));
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.trials == 0)
+        config.trials = 1;
+
+    // Default sizes: powers of ten from 10 up to --max-size (at most 10^7)
+    if (config.sizes.empty())
+        for (size_t n = 10; n <= maxSize && n <= 10000000; n *= 10)
+            config.sizes.push_back(n);
+
+    PmergeMe sorter;
+    sorter.setThreads(config.threads);
+
+    std::cout << "container,distribution,n,trials,median_us,p95_us,comparisons,"
+              << "ford_johnson_bound,std_sort_median_us,std_sort_comparisons,"
+              << "std_stable_sort_median_us,std_stable_sort_comparisons,"
+              << "ratio_std_sort,ratio_std_stable_sort" << std::endl;
+
+    std::vector<int> input;
+    for (size_t d = 0; d < config.distributions.size(); ++d)
+    {
+        for (size_t s = 0; s < config.sizes.size(); ++s)
+        {
+            if (!makeInput(config.distributions[d], config.sizes[s], input))
+            {
+                std::cerr << "Error: unknown distribution " << config.distributions[d] << std::endl;
+                return 1;
+            }
+            benchContainer<std::vector<int> >(sorter, "vector", config.distributions[d], input, config);
+            benchContainer<std::deque<int> >(sorter, "deque", config.distributions[d], input, config);
+        }
+    }
+    return 0;
+}
@@ -1,39 +1,126 @@
 #include "PmergeMe.hpp"
 
-bool isSorted(int argc, char **argv) 
+int main(int argc, char **argv)
 {
-    for (int i = 1; i < argc - 1; i++) 
+    PmergeMe sorter;
+    std::string inputPath;
+    bool binaryInput = false;
+    bool external = false;
+    std::string outputPath;
+    size_t memoryMiB = 256;
+
+    // Leading options; argv is shifted past them so argv[1] is the first number
+    while (argc > 1 && std::string(argv[1]).compare(0, 2, "--") == 0)
     {
-        int current = std::atoi(argv[i]);
-        int next = std::atoi(argv[i + 1]);
-        if (current > next)
-            return false;
+        std::string option = argv[1];
+        if (option == "--stats")
+            sorter.setInstrumented(true);
+        else if (option == "--threads" && argc > 2)
+        {
+            long threads = std::atol(argv[2]);
+            if (threads < 1)
+            {
+                std::cerr << "Error: --threads needs a positive count" << std::endl;
+                return 1;
+            }
+            sorter.setThreads(static_cast<size_t>(threads));
+            argv[2] = argv[0];
+            ++argv;
+            --argc;
+        }
+        else if (option == "--trials" && argc > 2)
+        {
+            long trials = std::atol(argv[2]);
+            if (trials < 1)
+            {
+                std::cerr << "Error: --trials needs a positive count" << std::endl;
+                return 1;
+            }
+            sorter.setTrials(static_cast<size_t>(trials));
+            argv[2] = argv[0];
+            ++argv;
+            --argc;
+        }
+        else if (option == "--dedup")
+            sorter.setDeduplicate(true);
+        else if (option == "--checksum")
+            sorter.setOutputMode(OUTPUT_CHECKSUM, 0);
+        else if (option == "--ends" && argc > 2)
+        {
+            sorter.setOutputMode(OUTPUT_ENDS, static_cast<size_t>(std::atol(argv[2])));
+            argv[2] = argv[0];
+            ++argv;
+            --argc;
+        }
+        else if (option == "--external")
+            external = true;
+        else if (option == "--memory" && argc > 2)
+        {
+            long memory = std::atol(argv[2]);
+            if (memory < 1)
+            {
+                std::cerr << "Error: --memory needs a positive size in MiB" << std::endl;
+                return 1;
+            }
+            memoryMiB = static_cast<size_t>(memory);
+            argv[2] = argv[0];
+            ++argv;
+            --argc;
+        }
+        else if (option == "--output" && argc > 2)
+        {
+            outputPath = argv[2];
+            argv[2] = argv[0];
+            ++argv;
+            --argc;
+        }
+        else if ((option == "--input" || option == "--binary") && argc > 2)
+        {
+            inputPath = argv[2];
+            binaryInput = (option == "--binary");
+            argv[2] = argv[0];
+            ++argv;
+            --argc;
+        }
+        else
+        {
+            std::cerr << "Error: unknown option " << option << std::endl;
+            return 1;
+        }
+        argv[1] = argv[0];
+        ++argv;
+        --argc;
     }
-    return true;
-}
 
-int main(int argc, char **argv)
-{
-
-    if (argc < 2)
+    if (external && (inputPath.empty() || outputPath.empty()))
     {
-        std::cerr << "Usage: " << argv[0] << " <positive_integer_sequence>" << std::endl;
+        std::cerr << "Error: --external needs --input or --binary, and --output" << std::endl;
         return 1;
     }
 
-        // Check if input is already sorted
-    if (isSorted(argc, argv)) 
+    if (!inputPath.empty())
     {
-        std::cout << "Input sequence is already sorted!" << std::endl;
-        // Print the sequence
-        std::cout << "Sequence: ";
-        for (int i = 1; i < argc; i++)
-            std::cout << argv[i] << " ";
-        std::cout << std::endl;
+        if (argc > 1)
+        {
+            std::cerr << "Error: numbers given together with an input file" << std::endl;
+            return 1;
+        }
+        if (external)
+            return sorter.sortExternal(inputPath, binaryInput, outputPath, memoryMiB << 20) ? 0 : 1;
+        sorter.sortAndMeasure(inputPath, binaryInput);
         return 0;
     }
 
-    PmergeMe sorter;
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--stats] [--threads N] [--trials N] [--dedup]"
+                  << " [--checksum | --ends K]"
+                  << " <positive_integer_sequence | --input FILE | --binary FILE>" << std::endl
+                  << "       " << argv[0] << " --external [--memory MiB] [--threads N]"
+                  << " --input FILE | --binary FILE --output FILE" << std::endl;
+        return 1;
+    }
+
     sorter.sortAndMeasure(argc, argv);
 
     return 0;